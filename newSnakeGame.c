@@ -1,3 +1,4 @@
+#define _GNU_SOURCE //asprintf()
 #include <stdio.h>
 #include <stdlib.h>
 #include <ncurses.h>
@@ -5,6 +6,14 @@
 #include <unistd.h>
 #include <string.h>
 #include <signal.h>
+#include <errno.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 /**
  * struct: drawableObj
@@ -26,7 +35,7 @@ enum Direction {
     down = 1,
     left = 2,
     right = 3
-} currentDirection;
+};
 
 
 void board(void);
@@ -37,24 +46,570 @@ void updateDisplay(void);
 void addSnakePiece(dObj);
 void removeSnakePiece(void);
 dObj snakeTail(void);
+dObj snakeHead(void);
 void initializeGame(void);
 void setDirection(enum Direction);
 dObj nextHead(void);
-void getEmptyCoords(int*, int*);
+bool getEmptyCoords(int*, int*);
 dObj trophy(int, int);
 dObj empty(int, int);
 void displayMessage(char*);
 void exitGame();
 chtype getCharAt(int,int);
+bool isFreeCell(int, int);
+void parseArgs(int, char**);
+void requestDirection(enum Direction);
+void publishFrame(void);
+void *simulationLoop(void*);
+void openShare(void);
+void publishShare(void);
+void closeShare(void);
+int spectate(pid_t);
+void loadHamiltonianCycle(int, int);
+void followHamiltonian(void);
+void alignWithHamiltonian(void);
+int compileLevel(const char*, const char*);
+void loadLevel(const char*);
+void drawLevel(void);
+int levelRegionAt(int, int);
+void followGreedy(void);
+int benchBody(uint64_t);
+int benchRegions(uint64_t);
+int benchTicks(uint64_t);
+void regionSeedFromLevel(void);
+void regionFreed(int, int);
+void regionOccupied(int, int);
+void regionFloodFill(void);
+void followLookahead(void);
+void stopLookahead(void);
+double monotonicSeconds(void);
+uint64_t gameHash(void);
+uint64_t fullCellHash(void);
+void recordHash(unsigned long);
 
-#define BOARD_ROWS (LINES - 1)
-#define BOARD_COLUMNS (COLS - 2)
-#define BOARD_HALF_PERIMETER (LINES + COLS - 3)
+#define BOARD_ROWS (yMax - 1)
+#define BOARD_COLUMNS (xMax - 2)
+#define BOARD_HALF_PERIMETER (yMax + xMax - 3)
 
-bool gameOver, trophyPresent, winGame;
-int xMax, yMax, snakeSize = 3, refreshDelay = 250, randNumber, trophy_time;
-time_t trophyCreationTime; 
-dObj prevTrophy; //to keep track of prev trophy
+int xMax, yMax, tickDelay;
+
+/**
+ * struct: gameState
+ * Purpose: everything that changes while the game runs, kept in one flat block of memory without pointers
+ *          so copying a game is a single memcpy of size bytes, see Code Block: Game state
+**/
+typedef struct gameState {
+    size_t size; // bytes of the whole state, including the pit and the snake behind this struct
+    size_t bodyOffset; // where the snakeChain starts, the pit starts right after this struct
+    size_t regionOffset; // where the union-find of the free cells starts, see Code Block: Regions
+    bool gameOver, trophyPresent, winGame;
+    int snakeSize, refreshDelay, randNumber, trophy_time, increaseLengthBy;
+    enum Direction currentDirection;
+    dObj prevTrophy; //to keep track of prev trophy
+    uint64_t tick, trophyExpiryTick;
+    uint64_t rng; // state of nextRandom()
+    const char *deathMessage; //extra message displayed before "Game Over", always a string literal
+    bool regionsDirty; // the head may have split a region since the union-find was built
+    uint32_t regionStamp, regionFloodBest; // marks of the flood fill used by --bench-regions
+    uint64_t regionRebuilds;
+    uint64_t hash; // Zobrist hash of the snake and trophy cells, see Code Block: State hash
+    uint64_t tickHash; // gameHash() as the last tick ended, what --hash-log and spectators see
+    chtype cells[]; // yMax * xMax, the snake pit
+} gameState;
+
+gameState *game = NULL; //the game being played
+_Thread_local gameState *state = NULL; //the game the functions work on in this thread, game or a lookahead copy
+gameState *newGameState(void);
+uint32_t nextRandom(void);
+
+// The snake can move onto a cell holding this, i.e, it is empty or a trophy
+static inline bool isFreeChar(chtype ch) {
+    return ch == ' ' || (ch >= '1' && ch <= '9');
+}
+
+// Zobrist key of a value in a slot of the state. The keys are a fixed function instead of a random table,
+// so hashes of the same game match across runs and builds and there is no table to miss the cache on.
+static inline uint64_t zobristKey(uint64_t slot, uint64_t value) {
+    uint64_t z = (slot << 16 | value) * 0x9E3779B97F4A7C15ull + 0x632BE59BD9B4E019ull; //splitmix64 finalizer
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Key of a cell holding ch, the walls and the border never change so only the snake and trophies count
+static inline uint64_t zobristCell(uint32_t cell, chtype ch) {
+    ch &= A_CHARTEXT;
+    return ch == '@' || (ch >= '1' && ch <= '9') ? zobristKey(cell, ch) : 0;
+}
+bool hamiltonianMode = false; //set by --hamiltonian, the snake steers itself along a hamiltonian cycle
+bool greedyMode = false; //set by --greedy, the snake steers itself straight at the trophy
+bool lookaheadMode = false; //set by --lookahead, the snake steers itself by playing out random futures
+int lookaheadBudget = 0; //set by --lookahead-ms, time in ms the lookahead gets per tick, 0 for half a tick
+enum RegionTracking {
+    regionsOff, // only the regions of the level, like before the union-find, see Code Block: Regions
+    regionsIncremental,
+    regionsFloodFill // flood fill every tick, the baseline of --bench-regions
+} regionTracking = regionsIncremental;
+bool headless = false; //no screen, the pit is yMax x xMax with a '#' border, for benchmarks
+uint64_t randomSeed = 0; //seed of the next game, 0 for one from the clock
+FILE *hashLog = NULL; //set by --hash-log, see Code Block: State hash
+bool checkHash = false; //set by --check-hash
+uint64_t ticksToBench = 0; //set by --bench-ticks, parseArgs() runs the benchmark once all options are read
+bool showStats = false; //set by --stats, prints the dropped frame counts on exit
+const int directionY[] = {-1, 1, 0, 0}, directionX[] = {0, 0, -1, 1}; //row and column step of each Direction
+
+//compiled level format, see Code Block: Levels
+#define LEVEL_MAGIC "SNKLVL1"
+#define LEVEL_NO_START UINT32_MAX
+#define LEVEL_UNREACHABLE UINT32_MAX
+#define LEVEL_LANDMARKS 8
+
+typedef struct levelHeader {
+    char magic[8];
+    uint32_t rows, cols; // the level covers the pit from its top left corner inside the border
+    uint32_t startY, startX; // start of the snake, LEVEL_NO_START to use the default
+    uint32_t regionCount, landmarkCount;
+    uint64_t wallOffset; // rows*cols bits, set for walls
+    uint64_t regionOffset; // rows*cols uint32_t, 0 for walls, 1.. for the connected region of floor cells
+    uint64_t distanceOffset; // landmarkCount arrays of rows*cols uint32_t steps from each landmark
+    uint64_t size;
+} levelHeader;
+
+const levelHeader *level = NULL;
+const uint8_t *levelWalls;
+const uint32_t *levelRegions, *levelDistances;
+const char *levelPath = NULL;
+double levelLoadTime; //seconds spent mapping the level
+
+
+/**
+ * Code Block: Event tracing
+ * Purpose: records timestamped spans and instant events into per-thread lock-free ring buffers and
+ *          dumps them as Chrome Trace Event JSON on exit (open with chrome://tracing or Perfetto).
+ *          Only compiled in with -DSNAKE_TRACE, otherwise the TRACE_* macros expand to nothing.
+ *          The output file is snake_trace.json unless SNAKE_TRACE_FILE is set.
+**/
+// --------------------------------------------------------------------------
+#ifdef SNAKE_TRACE
+#define TRACE_RING_SIZE 65536 // events kept per thread, must be a power of two
+
+typedef struct traceEvent {
+    uint64_t ts; // nanoseconds, CLOCK_MONOTONIC
+    const char *name; // always a string literal, so no copy is needed
+    char phase; // 'B' begin, 'E' end, 'i' instant
+} tEvent;
+
+typedef struct traceRing {
+    tEvent events[TRACE_RING_SIZE];
+    atomic_uint_fast64_t head; // number of events ever written, only the owning thread writes it
+    int tid;
+    struct traceRing *next;
+} tRing;
+
+static _Atomic(tRing*) traceRings = NULL; // every ring ever registered, pushed lock-free
+static atomic_int traceThreadCount = 0;
+static _Thread_local tRing *threadRing = NULL;
+static _Thread_local bool traceMuted = false;
+
+static inline uint64_t traceNow() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+// Allocates the ring of the calling thread the first time it emits an event
+static tRing* traceRegister() {
+    tRing *ring = calloc(1, sizeof(tRing));
+    ring->tid = atomic_fetch_add(&traceThreadCount, 1) + 1;
+    ring->next = atomic_load(&traceRings);
+    while (!atomic_compare_exchange_weak(&traceRings, &ring->next, ring));
+    return threadRing = ring;
+}
+
+// Appends an event to the ring of the calling thread, overwriting the oldest one when full
+static inline void traceEmit(const char *name, char phase) {
+    if (traceMuted) return;
+    tRing *ring = threadRing ? threadRing : traceRegister();
+    uint_fast64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    tEvent *event = &ring->events[head & (TRACE_RING_SIZE - 1)];
+    event->ts = traceNow();
+    event->name = name;
+    event->phase = phase;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// Writes the contents of every ring as a Chrome Trace Event JSON array
+void traceDump() {
+    const char *path = getenv("SNAKE_TRACE_FILE");
+    FILE *out = fopen(path ? path : "snake_trace.json", "w");
+    if (out == NULL) return;
+
+    bool first = true;
+    fprintf(out, "[\n");
+    for (tRing *ring = atomic_load(&traceRings); ring != NULL; ring = ring->next) {
+        uint_fast64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        uint_fast64_t start = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+        for (uint_fast64_t i = start; i < head; i++) {
+            tEvent *event = &ring->events[i & (TRACE_RING_SIZE - 1)];
+            fprintf(out, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d%s}",
+                    first ? "" : ",\n", event->name, event->phase, event->ts / 1000.0, ring->tid,
+                    event->phase == 'i' ? ",\"s\":\"t\"" : "");
+            first = false;
+        }
+    }
+    fprintf(out, "\n]\n");
+    fclose(out);
+}
+
+#define TRACE_BEGIN(name) traceEmit(name, 'B')
+#define TRACE_END(name) traceEmit(name, 'E')
+#define TRACE_INSTANT(name) traceEmit(name, 'i')
+#define TRACE_DUMP() traceDump()
+#define TRACE_MUTE() (traceMuted = true) // stops tracing the calling thread
+#else
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END(name) ((void)0)
+#define TRACE_INSTANT(name) ((void)0)
+#define TRACE_DUMP() ((void)0)
+#define TRACE_MUTE() ((void)0)
+#endif
+// --------------------------------------------------------------------------
+// End of Event tracing
+
+/**
+ * Code Block: Frame buffers
+ * Purpose: splits the game into a simulation thread and a render thread.
+ *          The simulation thread runs updateState() every tickDelay ms and publishes each finished tick
+ *          into one of three frames, the render thread (main) draws the newest one and skips stale ones.
+ *          Neither side waits for the other, so a slow terminal never delays a tick.
+ *          simFramesDropped counts frames the simulation replaced before they were drawn,
+ *          renderFramesSkipped counts ticks the renderer never drew.
+**/
+// --------------------------------------------------------------------------
+typedef struct frame {
+    uint64_t tick;
+    int score;
+    chtype cells[]; // yMax * xMax copy of the pit
+} frame;
+
+#define FRAME_COUNT 3
+#define FRAME_FRESH 4 // set next to the index in latestFrame until the renderer takes it
+#define INPUT_POLL_DELAY 5 // ms the render thread waits for a key before checking for a new frame
+
+frame *frames[FRAME_COUNT];
+atomic_int latestFrame = 1; // index of the newest published frame
+int backFrame = 0, frontFrame = 2; // frames owned by the simulation and render thread
+uint64_t lastDrawnTick = 0;
+atomic_bool simulationDone = false;
+#define DIRECTION_QUEUE_SIZE 8 // a power of two, so the free running indices wrap cleanly
+enum Direction directionQueue[DIRECTION_QUEUE_SIZE]; // turns requested by the render thread, one applied per tick
+atomic_uint directionHead = 0, directionTail = 0; // the simulation takes at the head, the render thread adds at the tail
+enum Direction lastRequestedDirection; // newest turn in the queue, or the current direction when it is empty
+atomic_ulong simFramesDropped = 0, renderFramesSkipped = 0, simLateTicks = 0;
+
+/**
+ * Function: requestDirection()
+ * Purpose: queues a direction from the input for the simulation, which applies one per tick.
+ *          A repeat of the last requested direction is dropped, as is a key that finds the queue full.
+ *          A reversal is queued like any turn, setDirection() ends the game when it comes up.
+**/
+void requestDirection(enum Direction newDirection) {
+    if (hamiltonianMode || greedyMode || lookaheadMode || newDirection == lastRequestedDirection) return;
+
+    unsigned tail = atomic_load_explicit(&directionTail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&directionHead, memory_order_acquire) == DIRECTION_QUEUE_SIZE) return;
+    directionQueue[tail % DIRECTION_QUEUE_SIZE] = newDirection;
+    atomic_store_explicit(&directionTail, tail + 1, memory_order_release);
+    lastRequestedDirection = newDirection;
+}
+
+/**
+ * Function: takeDirection()
+ * Purpose: applies the oldest queued direction, if there is one
+**/
+void takeDirection() {
+    unsigned head = atomic_load_explicit(&directionHead, memory_order_relaxed);
+    if (head == atomic_load_explicit(&directionTail, memory_order_acquire)) return;
+    setDirection(directionQueue[head % DIRECTION_QUEUE_SIZE]);
+    atomic_store_explicit(&directionHead, head + 1, memory_order_release);
+}
+
+/**
+ * Function: publishFrame()
+ * Purpose: copies the pit into the back frame and swaps it with the newest frame
+**/
+void publishFrame() {
+    frame *next = frames[backFrame];
+    next->tick = state->tick;
+    next->score = state->snakeSize;
+    memcpy(next->cells, state->cells, sizeof(chtype) * yMax * xMax);
+    publishShare();
+
+    int old = atomic_exchange(&latestFrame, backFrame | FRAME_FRESH);
+    if (old & FRAME_FRESH) atomic_fetch_add(&simFramesDropped, 1);
+    backFrame = old & ~FRAME_FRESH;
+}
+
+/**
+ * Function: updateDisplay()
+ * Purpose: draws the newest published frame if it has not been drawn yet
+**/
+void updateDisplay() {
+    if (!(atomic_load(&latestFrame) & FRAME_FRESH)) return;
+    frontFrame = atomic_exchange(&latestFrame, frontFrame) & ~FRAME_FRESH;
+
+    frame *shown = frames[frontFrame];
+    if (shown->tick > lastDrawnTick + 1)
+        atomic_fetch_add(&renderFramesSkipped, shown->tick - lastDrawnTick - 1);
+    lastDrawnTick = shown->tick;
+    for (int y = 0; y < yMax; y++)
+        for (int x = 0; x < xMax; x++)
+            mvaddch(y, x, shown->cells[y * xMax + x]);
+
+    TRACE_BEGIN("refresh");
+    refresh();
+    TRACE_END("refresh");
+}
+
+/**
+ * Function: simulationLoop()
+ * Purpose: body of the simulation thread, runs one tick every tickDelay ms until the game is over
+**/
+void *simulationLoop(void *arg) {
+    (void)arg;
+    struct timespec nextTick;
+    clock_gettime(CLOCK_MONOTONIC, &nextTick);
+    state = game;
+
+    while (!state->gameOver) {
+        takeDirection();
+        if (state->gameOver) break;
+
+        updateState(); // update game state
+        recordHash(1); //before the autopilots turn, the hash of a tick is the same everywhere
+        if (hamiltonianMode) followHamiltonian(); //pick the next direction along the cycle
+        if (greedyMode) followGreedy(); //pick the next direction towards the trophy
+        if (lookaheadMode && !state->gameOver) followLookahead(); //pick the next direction that plays out best
+        publishFrame();
+
+        //sleep until the next tick, a tick that is already late starts the schedule over
+        nextTick.tv_nsec += tickDelay * 1000000L;
+        nextTick.tv_sec += nextTick.tv_nsec / 1000000000L;
+        nextTick.tv_nsec %= 1000000000L;
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > nextTick.tv_sec || (now.tv_sec == nextTick.tv_sec && now.tv_nsec > nextTick.tv_nsec)) {
+            atomic_fetch_add(&simLateTicks, 1);
+            nextTick = now;
+        }
+        else
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &nextTick, NULL);
+    }
+    stopLookahead();
+    publishFrame();
+    atomic_store(&simulationDone, true);
+    return NULL;
+}
+// --------------------------------------------------------------------------
+// End of Frame buffers
+
+/**
+ * Code Block: Spectators
+ * Purpose: every game shares its pit, tick and score in the POSIX shared memory segment /snake-<pid>,
+ *          so any number of --spectate processes on the same host can watch it. The segment is a
+ *          seqlock: the simulation thread makes the sequence odd, copies the frame and makes it even
+ *          again, a spectator copies the frame out and keeps the copy only if the sequence was the same
+ *          even number before and after. Spectators map the segment read only, so the game never waits
+ *          for them and does not know how many there are; its cost is one copy of the pit per tick.
+**/
+// --------------------------------------------------------------------------
+#define SHARE_MAGIC "SNKSHM1"
+#define SHARE_PREFIX "snake-" // the segment of a game is /snake-<pid>, in /dev/shm on Linux
+#define SPECTATE_POLL_DELAY 10 // ms a spectator waits for a key before looking for a new tick
+
+typedef struct spectatorShare {
+    char magic[8];
+    uint32_t rows, cols;
+    uint32_t cellSize; // sizeof(chtype) of the game, a spectator has to match it
+    int32_t pid;
+    atomic_uint_fast64_t sequence; // odd while the game writes
+    uint64_t tick, hash;
+    int32_t score;
+    uint8_t gameOver, winGame;
+    atomic_bool closed; // set when the game exits, outside the seqlock as the exiting thread is not the writer
+    chtype cells[]; // rows * cols copy of the pit
+} spectatorShare;
+
+spectatorShare *share = NULL;
+size_t shareSize;
+char shareName[64];
+
+// Pid of the game a /dev/shm entry belongs to, 0 if it is not a game segment. The segment of a game
+// that no longer runs, killed or crashed before it could remove it, is removed and counts as none.
+pid_t sharedGamePid(const char *entryName) {
+    if (strncmp(entryName, SHARE_PREFIX, strlen(SHARE_PREFIX)) != 0) return 0;
+    pid_t pid = atoi(entryName + strlen(SHARE_PREFIX));
+    if (pid <= 0) return 0;
+    if (kill(pid, 0) != 0 && errno == ESRCH) {
+        char name[300];
+        snprintf(name, sizeof(name), "/%s", entryName);
+        shm_unlink(name);
+        return 0;
+    }
+    return pid;
+}
+
+// Removes the segments of games that are gone
+void removeDeadShares() {
+    DIR *dir = opendir("/dev/shm");
+    struct dirent *entry;
+    while (dir != NULL && (entry = readdir(dir)) != NULL) sharedGamePid(entry->d_name);
+    if (dir != NULL) closedir(dir);
+}
+
+/**
+ * Function: openShare()
+ * Purpose: creates the shared memory segment of this game, the game plays on without it if it fails.
+ *          Segments left behind by games that are gone are removed first.
+**/
+void openShare() {
+    if (share != NULL) return;
+    removeDeadShares();
+    snprintf(shareName, sizeof(shareName), "/" SHARE_PREFIX "%d", (int)getpid());
+    shareSize = sizeof(spectatorShare) + sizeof(chtype) * yMax * xMax;
+    int fd = shm_open(shareName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return;
+    if (ftruncate(fd, shareSize) == 0)
+        share = mmap(NULL, shareSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (share == MAP_FAILED || share == NULL) {
+        share = NULL;
+        shm_unlink(shareName);
+        return;
+    }
+    share->rows = yMax;
+    share->cols = xMax;
+    share->cellSize = sizeof(chtype);
+    share->pid = getpid();
+    atomic_init(&share->sequence, 0);
+    atomic_init(&share->closed, false);
+    memcpy(share->magic, SHARE_MAGIC, sizeof(share->magic)); //last, a spectator checks it first
+}
+
+// Starts and ends a write of the segment, readers retry while the sequence is odd or has changed
+static inline void beginShareWrite() {
+    atomic_store_explicit(&share->sequence, atomic_load_explicit(&share->sequence, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static inline void endShareWrite() {
+    atomic_store_explicit(&share->sequence, atomic_load_explicit(&share->sequence, memory_order_relaxed) + 1,
+                          memory_order_release);
+}
+
+/**
+ * Function: publishShare()
+ * Purpose: copies the tick the simulation just finished into the segment
+**/
+void publishShare() {
+    if (share == NULL) return;
+    beginShareWrite();
+    share->tick = state->tick;
+    share->hash = state->tickHash;
+    share->score = state->snakeSize;
+    share->gameOver = state->gameOver;
+    share->winGame = state->winGame;
+    memcpy(share->cells, state->cells, sizeof(chtype) * yMax * xMax);
+    endShareWrite();
+}
+
+/**
+ * Function: closeShare()
+ * Purpose: tells spectators the game is gone and removes the segment, on exit
+**/
+void closeShare() {
+    if (share == NULL) return;
+    atomic_store(&share->closed, true);
+    shm_unlink(shareName); //the mapping stays, the simulation thread may still be writing to it
+}
+
+// Pid of the newest game with a segment, 0 if there is none
+pid_t newestSharedGame() {
+    DIR *dir = opendir("/dev/shm");
+    pid_t newest = 0;
+    time_t newestTime = 0;
+    struct dirent *entry;
+    while (dir != NULL && (entry = readdir(dir)) != NULL) {
+        struct stat info;
+        char path[300];
+        pid_t pid = sharedGamePid(entry->d_name);
+        snprintf(path, sizeof(path), "/dev/shm/%s", entry->d_name);
+        if (pid > 0 && stat(path, &info) == 0 && info.st_mtime >= newestTime) {
+            newest = pid;
+            newestTime = info.st_mtime;
+        }
+    }
+    if (dir != NULL) closedir(dir);
+    return newest;
+}
+
+/**
+ * Function: spectate()
+ * Purpose: --spectate, draws the game with the given pid (or the newest one) from its segment until it
+ *          ends or q is pressed. The pit is drawn at the top left, a terminal too small shows part of it.
+**/
+int spectate(pid_t pid) {
+    char name[64];
+    if (pid <= 0) pid = newestSharedGame();
+    snprintf(name, sizeof(name), "/" SHARE_PREFIX "%d", (int)pid);
+    int fd = pid > 0 ? shm_open(name, O_RDONLY, 0) : -1;
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) < 0 || (size_t)info.st_size < sizeof(spectatorShare)) {
+        fprintf(stderr, "no game to spectate%s\n", pid > 0 ? " with that pid" : "");
+        return 1;
+    }
+    const spectatorShare *seen = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (seen == MAP_FAILED || memcmp(seen->magic, SHARE_MAGIC, sizeof(seen->magic)) != 0 ||
+        seen->cellSize != sizeof(chtype) || (size_t)info.st_size < sizeof(spectatorShare) + sizeof(chtype) * seen->rows * seen->cols) {
+        fprintf(stderr, "%s is not a game this build can spectate\n", name);
+        return 1;
+    }
+
+    int rows = seen->rows, cols = seen->cols;
+    spectatorShare *copy = calloc(1, sizeof(spectatorShare) + sizeof(chtype) * rows * cols);
+    uint64_t lastSequence = 1; //odd, never a finished write
+    initscr();
+    curs_set(false);
+    noecho();
+    timeout(SPECTATE_POLL_DELAY);
+    while (getch() != 'q' && !atomic_load((atomic_bool*)&seen->closed)) {
+        uint64_t before = atomic_load_explicit((atomic_uint_fast64_t*)&seen->sequence, memory_order_acquire);
+        if (before == lastSequence || before % 2 != 0) {
+            if (kill(pid, 0) != 0) break; //the game died without closing the segment
+            continue;
+        }
+        memcpy(copy, seen, sizeof(spectatorShare) + sizeof(chtype) * rows * cols);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit((atomic_uint_fast64_t*)&seen->sequence, memory_order_relaxed) != before) continue;
+        lastSequence = before;
+
+        for (int y = 0; y < rows && y < LINES; y++)
+            for (int x = 0; x < cols && x < COLS; x++)
+                mvaddch(y, x, copy->cells[y * cols + x]);
+        if (rows < LINES)
+            mvprintw(rows, 0, "spectating %d  tick %llu  score %d  hash %016llx%s", (int)pid,
+                     (unsigned long long)copy->tick, copy->score, (unsigned long long)copy->hash, copy->gameOver ? (copy->winGame ? "  won" : "  game over") : "");
+        refresh();
+    }
+    endwin();
+    printf("game %d: tick %llu, score %d%s\n", (int)pid, (unsigned long long)copy->tick, copy->score,
+           copy->gameOver ? (copy->winGame ? ", won" : ", game over") : "");
+    return 0;
+}
+// --------------------------------------------------------------------------
+// End of Spectators
 
 
 /**
@@ -62,23 +617,47 @@ dObj prevTrophy; //to keep track of prev trophy
  * Purpose: initializes the game and contains the main game loop that updates the state of game and ends the game
  * Author: Thomas & Moiz
 **/
-int main () {
+int main (int argc, char **argv) {
+    parseArgs(argc, argv);
+    if (levelPath != NULL) loadLevel(levelPath);
     initscr(); //initialize ncurses library
     refresh();
     curs_set(false); // Don't display a cursor
     noecho(); // Don't echo any keypresses
     keypad(stdscr, true);
     signal(SIGINT, exitGame); //catch the interrupt signal
+    signal(SIGTERM, exitGame); //and a kill or a closed terminal, so the spectator segment is removed
+    signal(SIGHUP, exitGame);
 
     initializeGame(); //initialize the game
+    publishFrame();
+    lastRequestedDirection = state->currentDirection;
+    timeout(INPUT_POLL_DELAY);
 
-    while (!gameOver) {
-        updateState(); // update game state
-        checkInput(); //check input and set direction
-        refresh(); //update display
+    //the simulation thread runs the game at a steady tick, this thread only reads keys and draws frames
+    pthread_t simulation;
+    sigset_t blocked, previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT); //keep the exit signals on this thread, it is the only one using ncurses
+    sigaddset(&blocked, SIGTERM);
+    sigaddset(&blocked, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+    pthread_create(&simulation, NULL, simulationLoop, NULL);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    while (!atomic_load(&simulationDone)) {
+        checkInput(); //check input and request a direction
+        updateDisplay(); //draw the newest frame
     }
+    pthread_join(simulation, NULL);
+    closeShare(); //the game is over, spectators keep the last tick
+    updateDisplay();
 
     //end game
+    if (state->deathMessage != NULL) {
+        displayMessage((char*)state->deathMessage);
+        sleep(2);
+    }
     usleep(700000);
     clear();
     start_color();
@@ -86,9 +665,9 @@ int main () {
     init_pair(2, COLOR_GREEN, COLOR_BLACK);
     attron(A_BOLD);
     char *scoreMsg;
-    asprintf(&scoreMsg, "Score: %d", snakeSize);
+    asprintf(&scoreMsg, "Score: %d", state->snakeSize);
 
-    if (winGame) {
+    if (state->winGame) {
         attron(COLOR_PAIR(2));
         displayMessage("You Won!");
         sleep(1);
@@ -108,6 +687,23 @@ int main () {
     attroff(A_BOLD);
 }
 
+/**
+ * Function: headWithRoom()
+ * Purpose: checks if the snake can start on a free position, and heads it where there are
+ *          free cells for the two other pieces and the first move
+**/
+bool headWithRoom(int y, int x) {
+    if (!isFreeCell(y, x)) return false;
+    for (int i = 0; i < 4; i++, state->currentDirection = (state->currentDirection + 1) % 4) {
+        int room = 0;
+        while (room < 3 && isFreeCell(y + directionY[state->currentDirection] * (room + 1),
+                                      x + directionX[state->currentDirection] * (room + 1)))
+            room++;
+        if (room == 3) return true;
+    }
+    return false;
+}
+
 /**
  * Function: initializeGame()
  * Purpose: initializes the game by setting up the snake pit, the snake and the first trophy
@@ -115,33 +711,61 @@ int main () {
 **/
 void initializeGame() {
     board(); //initialize the snake pit
-    refreshDelay -= (COLS < 250) ? (COLS/1.3) : 150; //decrease refresh dealy according to screen size
-    srand(time(NULL));
-    gameOver = false;
-    winGame = false;
-    trophyPresent = false;
+    if (hamiltonianMode) loadHamiltonianCycle(yMax - 2, xMax - 2); //cycle over the cells inside the border
+    if (level != NULL) { //walls of the level, and the regions it comes with
+        drawLevel();
+        regionSeedFromLevel();
+    }
+    state->refreshDelay -= (xMax < 250) ? (xMax/1.3) : 150; //decrease refresh dealy according to screen size
+    state->gameOver = false;
+    state->winGame = false;
+    state->trophyPresent = false;
 
     //initializing a snake with three characters going in random direction
-    currentDirection = rand()%4; //sets a random direction 0 - 3;
+    state->currentDirection = nextRandom()%4; //sets a random direction 0 - 3;
     dObj nextSnakePeice = {BOARD_ROWS/2, (BOARD_COLUMNS/2)-2, '@'};
+    if (level != NULL) { //start where the level says, heading where there is room for the snake
+        if (level->startY != LEVEL_NO_START) {
+            nextSnakePeice.y = level->startY + 1;
+            nextSnakePeice.x = level->startX + 1;
+        }
+        if (!headWithRoom(nextSnakePeice.y, nextSnakePeice.x)) { //the centre is a wall or beyond the level, or the @ is boxed in
+            long cellCount = (long)level->rows * level->cols, cell = 0;
+            while (cell < cellCount && !headWithRoom(cell / level->cols + 1, cell % level->cols + 1)) cell++;
+            if (cell == cellCount) {
+                endwin();
+                fprintf(stderr, "the level has no floor with room for the snake\n");
+                exit(1);
+            }
+            nextSnakePeice.y = cell / level->cols + 1;
+            nextSnakePeice.x = cell % level->cols + 1;
+        }
+    }
     displayObj(nextSnakePeice);
     addSnakePiece(nextSnakePeice);
 
+    if (hamiltonianMode) alignWithHamiltonian(); //the snake has to start in cycle order
     nextSnakePeice = nextHead();
     displayObj(nextSnakePeice);
     addSnakePiece(nextSnakePeice);
 
+    if (hamiltonianMode) alignWithHamiltonian();
     nextSnakePeice = nextHead();
     displayObj(nextSnakePeice);
     addSnakePiece(nextSnakePeice);
+    if (hamiltonianMode) alignWithHamiltonian();
 
     //create the initial trophy
-    if (!trophyPresent) {
+    if (!state->trophyPresent) {
+        TRACE_BEGIN("trophySpawn");
         int y,x;
-        getEmptyCoords(&y,&x);
-        displayObj(prevTrophy = trophy(y, x));
-        trophyPresent = true;
+        if (getEmptyCoords(&y,&x)) {
+            displayObj(state->prevTrophy = trophy(y, x));
+            state->trophyPresent = true;
+        }
+        TRACE_END("trophySpawn");
     }
+    state->tickHash = gameHash(); //of tick 0, for the first frame spectators see
 }
 
 /**
@@ -150,10 +774,26 @@ void initializeGame() {
  * Author: Corwin
 **/
 void board() {
-    getmaxyx(stdscr, yMax, xMax); //get dimentions of terminal
-    box(stdscr, 0, 0); //box representing the border
-    refresh();
-    timeout(refreshDelay);
+    if (!headless) {
+        getmaxyx(stdscr, yMax, xMax); //get dimentions of terminal
+        box(stdscr, 0, 0); //box representing the border
+        refresh();
+    }
+    game = state = newGameState();
+    if (tickDelay <= 0) tickDelay = state->refreshDelay; //unless --tick-ms set it
+
+    //the pit starts as a copy of the screen with the border
+    for (int y = 0; y < yMax; y++)
+        for (int x = 0; x < xMax; x++) {
+            bool border = y == 0 || y == yMax - 1 || x == 0 || x == xMax - 1;
+            state->cells[y * xMax + x] = headless ? (border ? '#' : ' ') : mvinch(y, x);
+        }
+    if (headless) return;
+
+    size_t frameSize = sizeof(frame) + sizeof(chtype) * yMax * xMax;
+    for (int i = 0; i < FRAME_COUNT; i++)
+        frames[i] = calloc(1, frameSize);
+    openShare(); //for --spectate
 }
 
 /**
@@ -162,7 +802,15 @@ void board() {
  * Author: Moiz
 **/
 void displayCharAt(int yPos, int xPos, chtype ch) {
-    mvaddch(yPos, xPos, ch);
+    if (yPos < 0 || yPos >= yMax || xPos < 0 || xPos >= xMax) return; //off the pit, like mvaddch() returning ERR
+    chtype *cell = &state->cells[yPos * xMax + xPos];
+    bool wasFree = isFreeChar(*cell);
+    state->hash ^= zobristCell(yPos * xMax + xPos, *cell) ^ zobristCell(yPos * xMax + xPos, ch);
+    *cell = ch;
+    if (wasFree && !isFreeChar(ch))
+        regionOccupied(yPos, xPos);
+    else if (!wasFree && isFreeChar(ch))
+        regionFreed(yPos, xPos);
 }
 
 /**
@@ -176,32 +824,34 @@ void displayObj(dObj obj) {
 
 /**
  * Function: checkInput()
- * Purpose: checks if key pressed is an arrow key and sets new direction
+ * Purpose: checks if key pressed is an arrow key and requests the new direction for the next tick
  * Author: Corwin & Tom
 **/
 void checkInput() {
+    TRACE_BEGIN("checkInput");
     chtype input = getch();
 
     switch (input) {
         case KEY_UP:
         case 'w':
-            setDirection(up);
+            requestDirection(up);
             break;
         case KEY_DOWN:
         case 's':
-            setDirection(down);
+            requestDirection(down);
             break;
         case KEY_RIGHT:
         case 'd':
-            setDirection(right);
+            requestDirection(right);
             break;
         case KEY_LEFT:
         case 'a':
-            setDirection(left);
+            requestDirection(left);
             break;
         default:
             break;
     }
+    TRACE_END("checkInput");
 }
 
 /**
@@ -210,145 +860,472 @@ void checkInput() {
  * Author: Corwin
 **/
 dObj trophy(int y, int x) {
-    randNumber = (rand()%9)+1;
-    trophy_time = (rand()%9)+1;
-    trophyCreationTime = time(NULL);
-    dObj trophy = {y, x, (randNumber + '0')};
+    state->randNumber = (nextRandom()%9)+1;
+    state->trophy_time = (nextRandom()%9)+1;
+    state->trophyExpiryTick = state->tick + (uint64_t)state->trophy_time * 1000 / tickDelay; //lifespan in ticks
+    dObj trophy = {y, x, (state->randNumber + '0')};
     return trophy;
 }
 
-int increaseLengthBy = 0;
 /**
  * Function: updateState()
  * Purpose: updates the state of the game, i.e, moves snake, creates new trophies, increases snake length and detects collisions
  * Author: Thomas, Moiz & Corwin
 **/
 void updateState() {
+    TRACE_BEGIN("updateState");
+    state->tick++;
     //getting next snake head
     dObj nextSnakePeice = nextHead();
     int nextY = nextSnakePeice.y, nextX = nextSnakePeice.x;
 
     if (getCharAt(nextY, nextX) == ' ') { //if snake moves across empty space
-        displayObj(empty(snakeTail().y, snakeTail().x));
-        removeSnakePiece();
+        if (state->increaseLengthBy > 1) { // increases length of the snake by keeping its tail
+            TRACE_INSTANT("grow");
+            state->increaseLengthBy--;
+            if (state->refreshDelay >= 60) state->refreshDelay -= 6; //increase snake speed proportionl to size
+        }
+        else {
+            displayObj(empty(snakeTail().y, snakeTail().x));
+            removeSnakePiece();
+        }
     }
     else if (getCharAt(nextY, nextX) >= 49 && getCharAt(nextY, nextX) <= 57) { //if snake eats a trophy
         //49 to 57 represent integrers 1 - 9 in acsii table
-        snakeSize += randNumber;
-        increaseLengthBy += randNumber;
-        trophyPresent = false;
+        state->snakeSize += state->randNumber;
+        state->increaseLengthBy += state->randNumber;
+        state->trophyPresent = false;
     }
     else {
-        gameOver = true;
+        state->gameOver = true;
+        TRACE_INSTANT("death");
         displayObj(empty(snakeTail().y, snakeTail().x));
         removeSnakePiece();
     }
-    // increases length of the snake
-    if (increaseLengthBy > 1) {
-        displayObj(nextSnakePeice);
-        addSnakePiece(nextSnakePeice);
-        increaseLengthBy--;
-        if (refreshDelay >= 60) refreshDelay -= 6; //increase snake speed proportionl to size
-    }
     displayObj(nextSnakePeice);
     addSnakePiece(nextSnakePeice);
+    if (regionTracking == regionsFloodFill) regionFloodFill();
 
     //Check the elapsed time from trophy creation against trophy lifespan
-    if((time(NULL) - trophyCreationTime) >= trophy_time){
-        if (getCharAt(prevTrophy.y, prevTrophy.x) != '@')
-            displayObj(empty(prevTrophy.y, prevTrophy.x));
-      trophyPresent = false;
+    if (state->tick >= state->trophyExpiryTick) {
+        TRACE_BEGIN("trophyExpire");
+        if (getCharAt(state->prevTrophy.y, state->prevTrophy.x) != '@')
+            displayObj(empty(state->prevTrophy.y, state->prevTrophy.x));
+        state->trophyPresent = false;
+        TRACE_END("trophyExpire");
     }
 
     //if trophy gets eaten by the snake create new one
-    if (!trophyPresent) {
+    if (!state->trophyPresent) {
+        TRACE_BEGIN("trophySpawn");
         int y,x;
-        getEmptyCoords(&y,&x);
-        displayObj(prevTrophy = trophy(y, x));
-        trophyPresent = true;
+        if (getEmptyCoords(&y,&x)) {
+            displayObj(state->prevTrophy = trophy(y, x));
+            state->trophyPresent = true;
+        }
+        TRACE_END("trophySpawn");
     }
 
     //check if snakeSize reaches half the perimeter of the board
-    if (snakeSize >= BOARD_HALF_PERIMETER) {
-        winGame = true;
-        gameOver = true;
+    if (state->snakeSize >= BOARD_HALF_PERIMETER) {
+        state->winGame = true;
+        state->gameOver = true;
     }
+    TRACE_END("updateState");
 }
 
 
 /**
- * Code Block: Queue implementation
- * Purpose: implements a queue data structure with the functions,
- *          peek() that returns the object at the front w/o dequeing,
- *          dequeue() that returns the object at the front and dequeues,
- *          enqueue() that queues an object at the back, and
- *          peekBack() that returns the object at the back w/o dequeing.
+ * Code Block: Snake body
+ * Purpose: stores the snake as the position of its tail and head plus the direction from every piece to the
+ *          next one towards the head, 2 bits each, in a circular bitstream. Adding a head and removing the
+ *          tail are O(1) and a piece costs 2 bits instead of a heap dObj and list node.
+ *          chainPieces() and nextPiece() walk the body from tail to head a 64 bit word at a time. The game
+ *          itself never walks it, the pit already shows every piece, so only --bench-body does.
  * Author: Moiz & Thomas
 **/
 // --------------------------------------------------------------------------
-// Queue implemented as a doubly linked list
-struct s_node {
-    dObj *object;
-    struct s_node *prev;
-    struct s_node *next;
-} *front=NULL, *back=NULL;
-typedef struct s_node node;
-
-// Returns the object at the front w/o dequeing
-dObj* peek() {
-    return front == NULL ? NULL : front->object;
-}
-
-// Returns the object at the front and dequeues
-dObj* dequeue() {
-    node *oldfront = front;
-    front = front->next;
-    return oldfront->object;
-}
-
-// Queues a object at the back
-void enqueue( dObj object )
-{
-   dObj *newobject   = (dObj*)  malloc( sizeof( object ) );
-   node *newnode = (node*) malloc( sizeof( node ) );
-
-   newobject->x = object.x;
-   newobject->y = object.y;
-   newobject->ch = object.ch;
-   newnode->object = newobject;
-
-   if( front == NULL && back == NULL )
-       front = back = newnode;
-   else {
-       back->next = newnode;
-       newnode->prev = back;
-       back = newnode;
-   }
-}
-
-// Returns the object at the back w/o dequeing.
-dObj* peekBack( ) {
-    return back == NULL ? NULL : back->object;
+typedef struct snakeChain {
+    int headY, headX, tailY, tailX;
+    uint64_t capacity; // directions the bitstream holds, a power of two
+    uint64_t first; // position of the direction leaving the tail
+    uint64_t count; // directions stored, one less than the number of pieces
+    uint64_t bits[]; // capacity * 2 bits
+} snakeChain;
+
+typedef struct chainIter {
+    int y, x; // current piece
+    const uint64_t *bits;
+    uint64_t mask, pos, left, word; // word holds the directions still unread in the word of pos
+} chainIter;
+
+// Bytes of a chain for a snake of up to pieces pieces
+size_t snakeChainSize(uint64_t pieces) {
+    uint64_t capacity = 32;
+    while (capacity < pieces) capacity *= 2;
+    return sizeof(snakeChain) + capacity / 4;
+}
+
+// Sets up an empty chain in size bytes of zeroed memory
+snakeChain *initSnakeChain(void *memory, size_t size) {
+    snakeChain *chain = memory;
+    chain->capacity = (size - sizeof(snakeChain)) * 4;
+    chain->first = 0;
+    chain->count = (uint64_t)-1; // no pieces yet
+    return chain;
+}
+
+// Allocates a chain for a snake of up to pieces pieces
+snakeChain *newSnakeChain(uint64_t pieces) {
+    size_t size = snakeChainSize(pieces);
+    return initSnakeChain(calloc(1, size), size);
+}
+
+// The body of the snake in the current state
+static inline snakeChain *snakeBody() {
+    return (snakeChain*)((char*)state + state->bodyOffset);
+}
+
+// Appends a head one step from the current head, or the first piece
+void chainPush(snakeChain *chain, int y, int x) {
+    if (chain->count == (uint64_t)-1) {
+        chain->headY = chain->tailY = y;
+        chain->headX = chain->tailX = x;
+        chain->count = 0;
+        return;
+    }
+    enum Direction dir = y < chain->headY ? up : y > chain->headY ? down : x < chain->headX ? left : right;
+    uint64_t pos = (chain->first + chain->count++) & (chain->capacity - 1);
+    chain->bits[pos / 32] = (chain->bits[pos / 32] & ~(3ull << (pos % 32 * 2))) | (uint64_t)dir << (pos % 32 * 2);
+    chain->headY = y;
+    chain->headX = x;
+}
+
+// Drops the tail, the snake always keeps its head
+void chainPop(snakeChain *chain) {
+    if (chain->count == 0 || chain->count == (uint64_t)-1) return;
+    uint64_t pos = chain->first & (chain->capacity - 1);
+    int dir = chain->bits[pos / 32] >> (pos % 32 * 2) & 3;
+    chain->tailY += directionY[dir];
+    chain->tailX += directionX[dir];
+    chain->first = (chain->first + 1) & (chain->capacity - 1);
+    chain->count--;
+}
+
+// Starts a walk at the tail
+chainIter chainPieces(const snakeChain *chain) {
+    chainIter it = {chain->tailY, chain->tailX, chain->bits, chain->capacity - 1, chain->first,
+                    chain->count == (uint64_t)-1 ? 0 : chain->count, 0};
+    it.word = it.bits[it.pos / 32] >> (it.pos % 32 * 2);
+    return it;
+}
+
+// Steps to the next piece towards the head, returns false once the head has been reached
+static inline bool nextPiece(chainIter *it) {
+    if (it->left == 0) return false;
+    int dir = it->word & 3;
+    it->y += directionY[dir];
+    it->x += directionX[dir];
+    it->left--;
+    it->pos = (it->pos + 1) & it->mask;
+    it->word = it->pos % 32 == 0 ? it->bits[it->pos / 32] : it->word >> 2;
+    return true;
+}
+// --------------------------------------------------------------------------
+// End of Snake body
+
+/**
+ * Code Block: Game state
+ * Purpose: the running game lives in one allocation, the gameState struct followed by the pit and the
+ *          snake body, with offsets instead of pointers. Copying it with memcpy gives a complete
+ *          independent game, body, pit, trophy and random numbers included, that the game functions
+ *          play on once the thread's state points at it.
+**/
+// --------------------------------------------------------------------------
+/**
+ * Function: newGameState()
+ * Purpose: allocates the state of a new game for a yMax x xMax pit
+**/
+gameState *newGameState() {
+    size_t cellsSize = sizeof(chtype) * yMax * xMax;
+    size_t bodyOffset = (sizeof(gameState) + cellsSize + 7) / 8 * 8;
+    size_t bodySize = snakeChainSize((uint64_t)yMax * xMax); //room for a snake filling the pit
+    size_t regionSize = 2 * sizeof(uint32_t) * yMax * xMax;
+    gameState *newState = calloc(1, bodyOffset + bodySize + regionSize);
+    newState->size = bodyOffset + bodySize + regionSize;
+    newState->bodyOffset = bodyOffset;
+    newState->regionOffset = bodyOffset + bodySize;
+    newState->regionsDirty = true; //built at the first spawn, or seeded from a level by initializeGame()
+    newState->snakeSize = 3;
+    newState->refreshDelay = 250;
+    newState->rng = randomSeed != 0 ? randomSeed : ((uint64_t)time(NULL) << 20) ^ getpid() ^ 0x9E3779B97F4A7C15ull;
+    initSnakeChain((char*)newState + bodyOffset, bodySize);
+    return newState;
+}
+
+/**
+ * Function: cloneGameState()
+ * Purpose: copies a whole game into memory of at least from->size bytes
+**/
+void cloneGameState(gameState *to, const gameState *from) {
+    memcpy(to, from, from->size);
+}
+
+/**
+ * Function: nextRandom()
+ * Purpose: random number generator kept in the state (xorshift64*), so copies of a game can replay it
+**/
+uint32_t nextRandom() {
+    uint64_t x = state->rng;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    state->rng = x;
+    return (x * 0x2545F4914F6CDD1Dull) >> 33;
+}
+// --------------------------------------------------------------------------
+// End of Game state
+
+/**
+ * Code Block: State hash
+ * Purpose: a 64 bit fingerprint of the game every tick, to find the exact tick two runs of the same game
+ *          stop matching. displayCharAt() keeps state->hash up to date as cells change: a head added, a
+ *          tail removed, a trophy placed, eaten or expired each XOR out the key of the old character of the
+ *          cell and XOR in the new one. gameHash() folds in the direction, pending growth and score.
+ *          --hash-log writes the hash of every tick, two logs of runs with the same --seed can be diffed.
+ *          --check-hash recomputes it from all cells every tick of --bench-ticks to test the updates.
+**/
+// --------------------------------------------------------------------------
+#define ZOBRIST_DIRECTION (1ull << 40) // slots for the fields folded in by gameHash(), past any cell
+#define ZOBRIST_GROWTH (ZOBRIST_DIRECTION + 1)
+#define ZOBRIST_SCORE (ZOBRIST_DIRECTION + 2)
+
+
+uint64_t gameHash() {
+    return state->hash ^ zobristKey(ZOBRIST_DIRECTION, state->currentDirection) ^
+           zobristKey(ZOBRIST_GROWTH, state->increaseLengthBy) ^ zobristKey(ZOBRIST_SCORE, state->snakeSize);
 }
+
+// The cell part of the hash computed from scratch
+uint64_t fullCellHash() {
+    uint64_t hash = 0;
+    for (uint32_t cell = 0; cell < (uint32_t)(yMax * xMax); cell++)
+        hash ^= zobristCell(cell, state->cells[cell]);
+    return hash;
+}
+
+/**
+ * Function: recordHash()
+ * Purpose: takes the hash of the tick that just ended, once, for spectators and the --hash-log file,
+ *          games are numbered for runs that play several
+**/
+void recordHash(unsigned long gameNumber) {
+    state->tickHash = gameHash();
+    if (hashLog != NULL)
+        fprintf(hashLog, "%lu %llu %016llx\n", gameNumber, (unsigned long long)state->tick, (unsigned long long)state->tickHash);
+}
+// --------------------------------------------------------------------------
+// End of State hash
+
+/**
+ * Code Block: Regions
+ * Purpose: keeps track of which free cells (empty or trophy) are connected, so trophies only spawn where
+ *          the head can get to. A union-find over the cells follows the game: a cell freed by the tail
+ *          is joined with its free neighbours, and a cell taken by the head can only split a region if
+ *          its free neighbours are not connected around it through the 8 cells next to it. Only then
+ *          the union-find is marked dirty and rebuilt, at the next spawn. Cells taken by the snake stay
+ *          in their set, so sets never have to be split otherwise. A level comes with its regions, the
+ *          union-find of its games starts from those instead of being built at the first spawn.
+ *          --bench-regions compares this against a flood fill from the head every tick.
+**/
 // --------------------------------------------------------------------------
-// End of Queue components
+#define REGION_ANY UINT32_MAX
+#define SPAWN_TRIES 64 // random picks before getEmptyCoords() looks at every cell
+
+static inline uint32_t *regionParent() {
+    return (uint32_t*)((char*)state + state->regionOffset);
+}
+
+static inline uint32_t *regionSize() {
+    return regionParent() + (size_t)yMax * xMax;
+}
+
+uint32_t regionFind(uint32_t cell) {
+    uint32_t *parent = regionParent();
+    while (parent[cell] != cell) {
+        parent[cell] = parent[parent[cell]];
+        cell = parent[cell];
+    }
+    return cell;
+}
+
+void regionUnion(uint32_t a, uint32_t b) {
+    uint32_t *parent = regionParent(), *size = regionSize();
+    a = regionFind(a);
+    b = regionFind(b);
+    if (a == b) return;
+    if (size[a] < size[b]) {
+        uint32_t swap = a;
+        a = b;
+        b = swap;
+    }
+    parent[b] = a;
+    size[a] += size[b];
+}
+
+// Builds the union-find from scratch, as a flood fill would
+void regionRebuild() {
+    uint32_t *parent = regionParent(), *size = regionSize();
+    for (uint32_t cell = 0; cell < (uint32_t)(yMax * xMax); cell++) {
+        parent[cell] = cell;
+        size[cell] = isFreeChar(state->cells[cell]);
+    }
+    for (int y = 1; y < yMax - 1; y++)
+        for (int x = 1; x < xMax - 1; x++) {
+            uint32_t cell = y * xMax + x;
+            if (!isFreeChar(state->cells[cell])) continue;
+            if (isFreeChar(state->cells[cell + 1])) regionUnion(cell, cell + 1);
+            if (isFreeChar(state->cells[cell + xMax])) regionUnion(cell, cell + xMax);
+        }
+    state->regionsDirty = false;
+    state->regionRebuilds++;
+}
+
+/**
+ * Function: regionSeedFromLevel()
+ * Purpose: sets up the union-find from the precomputed regions of the level, one set per region rooted
+ *          at its first cell. A single pass without unions or looking at the pit, before the snake is placed.
+**/
+void regionSeedFromLevel() {
+    if (regionTracking != regionsIncremental) return;
+    uint32_t *parent = regionParent(), *size = regionSize();
+    uint32_t *root = malloc(sizeof(uint32_t) * ((size_t)level->regionCount + 1)); //first cell of every region
+    for (uint32_t region = 0; region <= level->regionCount; region++) root[region] = REGION_ANY;
+    for (int y = 0; y < yMax; y++)
+        for (int x = 0; x < xMax; x++) {
+            uint32_t cell = y * xMax + x, region = levelRegionAt(y, x);
+            parent[cell] = cell;
+            size[cell] = 0;
+            if (region == 0 || region > level->regionCount) continue; //walls, the border and beyond the level
+            if (root[region] == REGION_ANY) root[region] = cell;
+            parent[cell] = root[region];
+            size[root[region]]++;
+        }
+    free(root);
+    state->regionsDirty = false;
+}
+
+/**
+ * Function: regionFreed()
+ * Purpose: joins a cell that just became free with the free cells next to it
+**/
+void regionFreed(int y, int x) {
+    if (regionTracking != regionsIncremental || state->regionsDirty) return;
+    for (int dir = up; dir <= right; dir++)
+        if (isFreeCell(y + directionY[dir], x + directionX[dir]))
+            regionUnion(y * xMax + x, (y + directionY[dir]) * xMax + x + directionX[dir]);
+}
+
+/**
+ * Function: regionOccupied()
+ * Purpose: marks the union-find dirty if taking this cell may have split its region
+**/
+void regionOccupied(int y, int x) {
+    if (regionTracking != regionsIncremental || state->regionsDirty) return;
+    //the 8 cells around, clockwise from above, even ones are the 4 neighbours
+    static const int ringY[] = {-1, -1, 0, 1, 1, 1, 0, -1}, ringX[] = {0, 1, 1, 1, 0, -1, -1, -1};
+    bool ring[8];
+    for (int i = 0; i < 8; i++) ring[i] = isFreeCell(y + ringY[i], x + ringX[i]);
+    //a free neighbour starts a new group unless the one before it reaches it around the corner
+    int groups = 0;
+    for (int i = 0; i < 8; i += 2)
+        if (ring[i] && !(ring[(i + 6) % 8] && ring[(i + 7) % 8])) groups++;
+    if (groups > 1) state->regionsDirty = true;
+}
+
+/**
+ * Function: regionFloodFill()
+ * Purpose: baseline for --bench-regions, marks the free cells reachable from each side of the head
+ *          and remembers the mark of the biggest area
+**/
+void regionFloodFill() {
+    uint32_t *mark = regionParent(), *queue = regionSize(), bestCount = 0, firstStamp = state->regionStamp + 1;
+    dObj head = snakeHead();
+    for (int dir = up; dir <= right; dir++) {
+        uint32_t start = (head.y + directionY[dir]) * xMax + head.x + directionX[dir];
+        if (!isFreeCell(head.y + directionY[dir], head.x + directionX[dir]) || mark[start] >= firstStamp) continue;
+        uint32_t stamp = ++state->regionStamp, head = 0, tail = 0;
+        mark[start] = stamp;
+        queue[tail++] = start;
+        while (head < tail) {
+            uint32_t cell = queue[head++];
+            for (int next = up; next <= right; next++) {
+                uint32_t n = cell + directionY[next] * xMax + directionX[next];
+                if (mark[n] == stamp || !isFreeChar(state->cells[n])) continue;
+                mark[n] = stamp;
+                queue[tail++] = n;
+            }
+        }
+        if (tail > bestCount) {
+            bestCount = tail;
+            state->regionFloodBest = stamp;
+        }
+    }
+}
+
+/**
+ * Function: spawnRegion()
+ * Purpose: gets the region trophies should spawn in, the biggest one next to the head
+**/
+uint32_t spawnRegion() {
+    dObj head = snakeHead();
+    if (regionTracking == regionsFloodFill) return state->regionFloodBest;
+    if (regionTracking == regionsOff) { //the head sits on a snake piece, take the region of a free cell next to it
+        int region = 0;
+        for (int dir = up; dir <= right && region == 0; dir++)
+            region = levelRegionAt(head.y + directionY[dir], head.x + directionX[dir]);
+        return region == 0 ? (uint32_t)levelRegionAt(head.y, head.x) : (uint32_t)region;
+    }
+
+    if (state->regionsDirty) regionRebuild();
+    uint32_t best = REGION_ANY, bestSize = 0;
+    for (int dir = up; dir <= right; dir++) {
+        if (!isFreeCell(head.y + directionY[dir], head.x + directionX[dir])) continue;
+        uint32_t region = regionFind((head.y + directionY[dir]) * xMax + head.x + directionX[dir]);
+        if (regionSize()[region] > bestSize) {
+            best = region;
+            bestSize = regionSize()[region];
+        }
+    }
+    return best;
+}
+
+// Checks if a trophy at this position would be in the region from spawnRegion()
+bool inSpawnRegion(int y, int x, uint32_t region) {
+    if (region == REGION_ANY) return true;
+    if (regionTracking == regionsOff) return (uint32_t)levelRegionAt(y, x) == region;
+    if (regionTracking == regionsFloodFill) return regionParent()[y * xMax + x] == region;
+    return regionFind(y * xMax + x) == region;
+}
+// --------------------------------------------------------------------------
+// End of Regions
 
 /**
  * Function: addSnakePiece()
- * Purpose: adds a snake piece to the queue
+ * Purpose: adds a snake piece in front of the head
  * Author: Corwin
 **/
 void addSnakePiece(dObj piece) {
-    enqueue(piece);
+    chainPush(snakeBody(), piece.y, piece.x);
 }
 
 /**
  * Function: removeSnakePiece()
- * Purpose: removes a snake piece from the queue
+ * Purpose: removes the tail piece of the snake
  * Author: Corwin
 **/
 void removeSnakePiece() {
-    dequeue();
+    chainPop(snakeBody());
 }
 
 /**
@@ -357,7 +1334,9 @@ void removeSnakePiece() {
  * Author: Thomas
 **/
 dObj snakeTail() {
-    return *peek();
+    snakeChain *body = snakeBody();
+    dObj tail = {body->tailY, body->tailX, '@'};
+    return tail;
 }
 
 /**
@@ -366,7 +1345,9 @@ dObj snakeTail() {
  * Author: Thomas
 **/
 dObj snakeHead() {
-    return *peekBack();
+    snakeChain *body = snakeBody();
+    dObj head = {body->headY, body->headX, '@'};
+    return head;
 }
 
 /**
@@ -376,14 +1357,15 @@ dObj snakeHead() {
 **/
 void setDirection(enum Direction newDirection) {
 // change in direction is illegal if sum is 1 or 5.
-    int num = currentDirection + newDirection;
+    int num = state->currentDirection + newDirection;
     if(num == 1 || num == 5) {
-        gameOver = true;
-        displayMessage("Wrong Direction! You ran into yourself.");
-        sleep(2);
+        state->gameOver = true;
+        TRACE_INSTANT("death");
+        state->deathMessage = "Wrong Direction! You ran into yourself.";
         return;
     }
-    currentDirection = newDirection;
+    if (state->currentDirection != newDirection) TRACE_INSTANT("turn");
+    state->currentDirection = newDirection;
 }
 
 /**
@@ -395,7 +1377,7 @@ dObj nextHead() {
     int currRow = snakeHead().y;
     int currCol = snakeHead().x;
 
-    switch (currentDirection) {
+    switch (state->currentDirection) {
         case down:
             currRow++;
             break;
@@ -429,18 +1411,971 @@ dObj empty(int y, int x) { //used to empty out a spot on the board
  * Author: Moiz
 **/
 chtype getCharAt(int y, int x) {
-    return mvinch(y, x);
+    if (y < 0 || y >= yMax || x < 0 || x >= xMax) return (chtype)ERR;
+    return state->cells[y * xMax + x];
 }
 
 /**
  * Function: getEmptyCoords()
- * Purpose: gets a set of random empty coords within border for trophy
+ * Purpose: gets a set of random empty coords within border for trophy that the head can reach,
+ *          returns false if there are none
  * Author: Moiz
 **/
-void getEmptyCoords(int *y, int *x) { //gets a set of random empty coords for trophy
-    while (getCharAt(*y = rand() % (BOARD_ROWS-1), *x = rand() % (BOARD_COLUMNS-1)) != ' ');
+bool getEmptyCoords(int *y, int *x) { //gets a set of random empty coords for trophy
+    uint32_t region = spawnRegion();
+    for (int tries = 0; tries < SPAWN_TRIES; tries++)
+        if (getCharAt(*y = nextRandom() % (BOARD_ROWS-1), *x = nextRandom() % (BOARD_COLUMNS-1)) == ' ' &&
+            inSpawnRegion(*y, *x, region))
+            return true;
+
+    //the region is (nearly) full, count its empty cells and take a random one of them
+    long count = 0, pick;
+    for (*y = 0; *y < BOARD_ROWS-1; (*y)++)
+        for (*x = 0; *x < BOARD_COLUMNS-1; (*x)++)
+            count += getCharAt(*y, *x) == ' ' && inSpawnRegion(*y, *x, region);
+    if (count == 0) return false;
+    pick = nextRandom() % count;
+    for (*y = 0; *y < BOARD_ROWS-1; (*y)++)
+        for (*x = 0; *x < BOARD_COLUMNS-1; (*x)++)
+            if (getCharAt(*y, *x) == ' ' && inSpawnRegion(*y, *x, region) && pick-- == 0)
+                return true;
+    return false;
+}
+
+/**
+ * Function: monotonicSeconds()
+ * Purpose: reads the monotonic clock in seconds, for timing
+**/
+double monotonicSeconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * Function: isFreeCell()
+ * Purpose: checks if the snake can move onto the specified position, i.e, it is empty or holds a trophy
+**/
+bool isFreeCell(int y, int x) {
+    return isFreeChar(getCharAt(y, x));
+}
+
+/**
+ * Function: parseArgs()
+ * Purpose: reads the command line options
+**/
+void parseArgs(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--hamiltonian") == 0)
+            hamiltonianMode = true;
+        else if (strcmp(argv[i], "--greedy") == 0)
+            greedyMode = true;
+        else if (strcmp(argv[i], "--lookahead") == 0)
+            lookaheadMode = true;
+        else if (strcmp(argv[i], "--lookahead-ms") == 0 && i + 1 < argc)
+            lookaheadBudget = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--tick-ms") == 0 && i + 1 < argc)
+            tickDelay = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--spectate") == 0)
+            exit(spectate(i + 1 < argc ? atoi(argv[i + 1]) : 0));
+        else if (strcmp(argv[i], "--stats") == 0)
+            showStats = true;
+        else if (strcmp(argv[i], "--level") == 0 && i + 1 < argc)
+            levelPath = argv[++i];
+        else if (strcmp(argv[i], "--compile-level") == 0 && i + 2 < argc)
+            exit(compileLevel(argv[i + 1], argv[i + 2]));
+        else if (strcmp(argv[i], "--bench-body") == 0)
+            exit(benchBody(i + 1 < argc ? strtoull(argv[i + 1], NULL, 10) : 1000000));
+        else if (strcmp(argv[i], "--bench-regions") == 0)
+            exit(benchRegions(i + 1 < argc ? strtoull(argv[i + 1], NULL, 10) : 200000));
+        else if (strcmp(argv[i], "--bench-ticks") == 0)
+            ticksToBench = i + 1 < argc ? strtoull(argv[++i], NULL, 10) : 200000;
+        else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc && sscanf(argv[i + 1], "%dx%d", &yMax, &xMax) == 2)
+            i++; //the pit without a screen, border included
+        else if (strcmp(argv[i], "--hash-log") == 0 && i + 1 < argc) {
+            if ((hashLog = fopen(argv[++i], "w")) == NULL) {
+                perror(argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--check-hash") == 0)
+            checkHash = true;
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            randomSeed = strtoull(argv[++i], NULL, 10);
+        else {
+            fprintf(stderr, "usage: %s [--hamiltonian | --greedy | --lookahead [--lookahead-ms ms]] [--level file.lvl] [--tick-ms ms] [--stats]\n"
+                            "          [--seed n] [--hash-log file]\n"
+                            "       %s --spectate [pid]\n"
+                            "       %s --compile-level level.txt level.lvl\n"
+                            "       %s --bench-body [segments]\n"
+                            "       %s [--size rowsxcols] [--seed n] --bench-regions [ticks]\n"
+                            "       %s [--hamiltonian | --greedy] [--level file.lvl] [--size rowsxcols] [--seed n] [--hash-log file]\n"
+                            "          [--check-hash] --bench-ticks [ticks]\n",
+                            argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
+            exit(1);
+        }
+    }
+    if (hamiltonianMode + greedyMode + lookaheadMode > 1) {
+        fprintf(stderr, "%s: only one of --hamiltonian, --greedy and --lookahead can steer\n", argv[0]);
+        exit(1);
+    }
+    if (hamiltonianMode && levelPath != NULL) {
+        fprintf(stderr, "%s: --hamiltonian needs the whole pit, it can not be used with --level\n", argv[0]);
+        exit(1);
+    }
+    if (ticksToBench > 0) {
+        if (lookaheadMode) {
+            fprintf(stderr, "%s: --lookahead plays to the clock, it can not be used with --bench-ticks\n", argv[0]);
+            exit(1);
+        }
+        if (levelPath != NULL) loadLevel(levelPath);
+        exit(benchTicks(ticksToBench));
+    }
+}
+
+/**
+ * Code Block: Hamiltonian cycle
+ * Purpose: perfect play mode. The snake follows a cycle that visits every cell inside the border once,
+ *          so it can never run into itself, and takes shortcuts towards the trophy while it is short
+ *          enough that skipping part of the cycle cannot trap it.
+ *          A cycle is built once per board size and cached as a file of cycle positions, one uint32_t
+ *          per cell, that later starts just mmap. The cache lives in $XDG_CACHE_HOME/snake (or
+ *          ~/.cache/snake) as hamiltonian-<rows>x<cols>.bin.
+**/
+// --------------------------------------------------------------------------
+#define HAM_MAGIC "SNKHAM1"
+#define HAM_OFF_CYCLE UINT32_MAX // position of a cell the cycle does not visit
+#define HAM_SHORTCUT_MARGIN 10 // free cells kept between head and tail after a shortcut, one more than the largest trophy
+
+typedef struct hamiltonianCacheHeader {
+    char magic[8];
+    uint32_t rows, cols;
+    uint32_t length; // number of cells on the cycle
+} hamHeader; // followed by rows*cols uint32_t cycle positions, row major
+
+uint32_t *hamOrder = NULL; // cycle position of every cell inside the border
+uint32_t hamLength = 0;
+int hamRows, hamCols;
+
+// Numbers the cells of a rows x cols grid in cycle order and returns the cycle length.
+// A cycle needs an even number of cells, so on an odd x odd grid the last column is left out.
+uint32_t buildHamiltonianCycle(uint32_t *order, int rows, int cols) {
+    int usedCols = cols;
+    bool transpose = false;
+    for (int i = 0; i < rows * cols; i++) order[i] = HAM_OFF_CYCLE;
+    if (rows % 2 != 0) {
+        if (cols % 2 != 0) usedCols--;
+        transpose = true;
+    }
+
+    // zig-zag through columns 1.. of every row of an even number of rows, then return up column 0
+    int a = transpose ? usedCols : rows, b = transpose ? rows : usedCols;
+    if (a < 2 || b < 2) return 0;
+    uint32_t n = 0;
+#define HAM_CELL(i, j) order[transpose ? (j) * cols + (i) : (i) * cols + (j)]
+    for (int j = 0; j < b; j++) HAM_CELL(0, j) = n++;
+    for (int i = 1; i < a; i++) {
+        if (i % 2 != 0)
+            for (int j = b - 1; j >= 1; j--) HAM_CELL(i, j) = n++;
+        else
+            for (int j = 1; j < b; j++) HAM_CELL(i, j) = n++;
+    }
+    for (int i = a - 1; i >= 1; i--) HAM_CELL(i, 0) = n++;
+#undef HAM_CELL
+    return n;
+}
+
+// Creates a directory and any missing parents, like mkdir -p. XDG wants 0700 for directories it makes.
+void makeDirectories(char *path) {
+    for (char *slash = strchr(path + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        mkdir(path, 0700);
+        *slash = '/';
+    }
+    mkdir(path, 0700);
+}
+
+// Writes the cache file path for a board size into path, creating the cache directory,
+// returns false if there is no cache directory
+bool hamCachePath(char *path, size_t size, int rows, int cols) {
+    const char *xdg = getenv("XDG_CACHE_HOME"), *home = getenv("HOME");
+    if (xdg != NULL && *xdg != '\0')
+        snprintf(path, size, "%s/snake", xdg);
+    else if (home != NULL && *home != '\0')
+        snprintf(path, size, "%s/.cache/snake", home);
+    else
+        return false;
+    makeDirectories(path);
+    size_t len = strlen(path);
+    return (size_t)snprintf(path + len, size - len, "/hamiltonian-%dx%d.bin", rows, cols) < size - len;
+}
+
+// Maps an existing cache file, returns false if it is missing, was written for another board size
+// or does not hold a cycle: a length of 1..rows*cols and exactly length cells with a position below it
+bool mapHamiltonianCache(const char *path, int rows, int cols) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    size_t size = sizeof(hamHeader) + (size_t)rows * cols * sizeof(uint32_t);
+    void *map = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && (size_t)info.st_size == size)
+        map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+
+    hamHeader *header = map;
+    if (memcmp(header->magic, HAM_MAGIC, sizeof(header->magic)) != 0 ||
+        header->rows != (uint32_t)rows || header->cols != (uint32_t)cols ||
+        header->length == 0 || header->length > (uint64_t)rows * cols) {
+        munmap(map, size);
+        return false;
+    }
+    const uint32_t *order = (const uint32_t*)(header + 1);
+    uint32_t onCycle = 0;
+    for (size_t i = 0; i < (size_t)rows * cols; i++) {
+        if (order[i] < header->length) onCycle++;
+        else if (order[i] != HAM_OFF_CYCLE) {
+            onCycle = 0; //not a cycle position, length is above 0 so this fails below
+            break;
+        }
+    }
+    if (onCycle != header->length) {
+        munmap(map, size);
+        return false;
+    }
+    hamOrder = (uint32_t*)(header + 1);
+    hamLength = header->length;
+    return true;
+}
+
+/**
+ * Function: loadHamiltonianCycle()
+ * Purpose: maps the cached cycle for the board size, or builds it and writes it to the cache
+**/
+void loadHamiltonianCycle(int rows, int cols) {
+    char path[4096];
+    if (hamOrder != NULL && rows == hamRows && cols == hamCols) return; //already loaded by an earlier game
+    hamRows = rows;
+    hamCols = cols;
+    bool cached = hamCachePath(path, sizeof(path), rows, cols);
+    if (cached && mapHamiltonianCache(path, rows, cols)) return;
+
+    size_t size = sizeof(hamHeader) + (size_t)rows * cols * sizeof(uint32_t);
+    hamHeader *header = calloc(1, size);
+    memcpy(header->magic, HAM_MAGIC, sizeof(header->magic));
+    header->rows = rows;
+    header->cols = cols;
+    header->length = buildHamiltonianCycle((uint32_t*)(header + 1), rows, cols);
+    hamOrder = (uint32_t*)(header + 1);
+    hamLength = header->length;
+    if (!cached) return;
+
+    // write to a temporary file first so a concurrent start never maps a half written cache
+    char tmpPath[4096 + 32];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.%d", path, (int)getpid());
+    FILE *out = fopen(tmpPath, "wb");
+    if (out == NULL) return;
+    bool written = fwrite(header, size, 1, out) == 1;
+    if (fclose(out) == 0 && written)
+        rename(tmpPath, path);
+    else
+        unlink(tmpPath);
+}
+
+// Cycle position of a screen position, HAM_OFF_CYCLE outside the cycle
+uint32_t hamPosition(int y, int x) {
+    if (y < 1 || y > hamRows || x < 1 || x > hamCols) return HAM_OFF_CYCLE;
+    return hamOrder[(y - 1) * hamCols + (x - 1)];
+}
+
+// Number of steps along the cycle from position a to position b
+uint32_t hamDistance(uint32_t a, uint32_t b) {
+    return b >= a ? b - a : b + hamLength - a;
+}
+
+/**
+ * Function: alignWithHamiltonian()
+ * Purpose: points the snake at the cell after the head on the cycle, used while placing the first pieces.
+ *          A snake laid against the cycle order would have its own body ahead on the cycle.
+**/
+void alignWithHamiltonian() {
+    dObj head = snakeHead();
+    uint32_t h = hamPosition(head.y, head.x);
+    if (h == HAM_OFF_CYCLE) return;
+    for (int dir = up; dir <= right; dir++)
+        if (hamPosition(head.y + directionY[dir], head.x + directionX[dir]) == (h + 1) % hamLength)
+            state->currentDirection = dir;
+}
+
+/**
+ * Function: followHamiltonian()
+ * Purpose: sets the direction that moves the snake to the next cell of the cycle, or further along
+ *          the cycle towards the trophy when the skipped cells leave enough room in front of the tail
+**/
+void followHamiltonian() {
+    if (hamLength == 0) return;
+
+    dObj head = snakeHead();
+    uint32_t h = hamPosition(head.y, head.x), t = hamPosition(snakeTail().y, snakeTail().x);
+    uint32_t trophyPos = state->trophyPresent ? hamPosition(state->prevTrophy.y, state->prevTrophy.x) : HAM_OFF_CYCLE;
+    if (h == HAM_OFF_CYCLE) return;
+    uint32_t toTail = t == HAM_OFF_CYCLE ? 0 : hamDistance(h, t);
+    uint32_t toTrophy = trophyPos == HAM_OFF_CYCLE ? hamLength : hamDistance(h, trophyPos);
+    bool shortcuts = (uint32_t)state->snakeSize < hamLength / 2; //a long snake has no room to skip cells
+    //skipped cells only come back once the tail passes them, until then the free cells in front of the head
+    //have to hold all the growth still to come: what is pending and what it takes to win
+    int toGrow = BOARD_HALF_PERIMETER - state->snakeSize + state->increaseLengthBy;
+    uint32_t reserve = (toGrow > 0 ? toGrow : 0) + HAM_SHORTCUT_MARGIN;
+
+    int best = -1, fallback = -1;
+    uint32_t bestStep = 0;
+    for (int dir = up; dir <= right; dir++) {
+        int y = head.y + directionY[dir], x = head.x + directionX[dir];
+        uint32_t n = hamPosition(y, x);
+        if (!isFreeCell(y, x)) continue;
+        if (fallback < 0) fallback = dir;
+        if (n == HAM_OFF_CYCLE) continue;
+
+        uint32_t step = hamDistance(h, n);
+        if (step != 1) { //anything but the next cell of the cycle is a shortcut
+            if (!shortcuts || step > toTrophy || step >= toTail) continue;
+            if (toTail - step <= reserve) continue;
+        }
+        if (best < 0 || step > bestStep) {
+            best = dir;
+            bestStep = step;
+        }
+    }
+    if (best < 0) best = fallback;
+    if (best >= 0) setDirection(best);
+}
+// --------------------------------------------------------------------------
+// End of Hamiltonian cycle
+
+/**
+ * Code Block: Levels
+ * Purpose: obstacle maps. A level is designed as text ('#' is a wall, '@' the start, anything else floor)
+ *          and compiled once with --compile-level into a binary file that --level maps as is, so starting
+ *          does no parsing. Next to the wall bitmap the file holds the connected region of every cell,
+ *          used to only spawn trophies where the head can get to, and the distance from a few landmark
+ *          cells to every cell. Those give a lower bound on the distance between any two cells
+ *          without storing distances for all pairs, which --greedy uses to steer.
+**/
+// --------------------------------------------------------------------------
+// Breadth first search over the floor of a level from one cell, writes the steps to every cell into dist
+void levelSearch(const uint8_t *walls, int rows, int cols, uint32_t from, uint32_t *dist, uint32_t *queue) {
+    size_t cellCount = (size_t)rows * cols, head = 0, tail = 0;
+    for (size_t i = 0; i < cellCount; i++) dist[i] = LEVEL_UNREACHABLE;
+    dist[from] = 0;
+    queue[tail++] = from;
+    while (head < tail) {
+        uint32_t cell = queue[head++];
+        int y = cell / cols, x = cell % cols;
+        for (int dir = up; dir <= right; dir++) {
+            int ny = y + directionY[dir], nx = x + directionX[dir];
+            if (ny < 0 || ny >= rows || nx < 0 || nx >= cols) continue;
+            uint32_t next = ny * cols + nx;
+            if (dist[next] != LEVEL_UNREACHABLE || (walls[next / 8] >> (next % 8) & 1)) continue;
+            dist[next] = dist[cell] + 1;
+            queue[tail++] = next;
+        }
+    }
+}
+
+/**
+ * Function: compileLevel()
+ * Purpose: turns a text level into the binary level format, returns the exit code for main
+**/
+int compileLevel(const char *textPath, const char *levelFile) {
+    FILE *in = fopen(textPath, "r");
+    if (in == NULL) {
+        perror(textPath);
+        return 1;
+    }
+    //first pass for the size, second pass for the cells
+    int rows = 0, cols = 0, len = 0, ch;
+    while ((ch = fgetc(in)) != EOF) {
+        if (ch == '\n') {
+            rows++;
+            len = 0;
+        }
+        else if (++len > cols)
+            cols = len;
+    }
+    if (len > 0) rows++;
+    if (rows == 0 || cols == 0) {
+        fprintf(stderr, "%s: empty level\n", textPath);
+        fclose(in);
+        return 1;
+    }
+
+    size_t cellCount = (size_t)rows * cols;
+    size_t wallBytes = (cellCount + 63) / 64 * 8;
+    uint8_t *walls = calloc(wallBytes, 1);
+    uint32_t *regions = calloc(cellCount, sizeof(uint32_t));
+    uint32_t *distances = malloc(cellCount * sizeof(uint32_t) * LEVEL_LANDMARKS);
+    uint32_t *nearest = malloc(cellCount * sizeof(uint32_t)); //steps to the closest landmark so far
+    uint32_t *queue = malloc(cellCount * sizeof(uint32_t));
+    levelHeader header = {.magic = LEVEL_MAGIC, .rows = rows, .cols = cols,
+                          .startY = LEVEL_NO_START, .startX = LEVEL_NO_START};
+
+    rewind(in);
+    for (int y = 0, x = 0; (ch = fgetc(in)) != EOF;) {
+        if (ch == '\n') {
+            for (; x < cols; x++) walls[(y * cols + x) / 8] |= 1 << ((y * cols + x) % 8); //short lines end in wall
+            y++;
+            x = 0;
+            continue;
+        }
+        if (ch == '#') walls[(y * cols + x) / 8] |= 1 << ((y * cols + x) % 8);
+        if (ch == '@') {
+            header.startY = y;
+            header.startX = x;
+        }
+        x++;
+    }
+    fclose(in);
+
+    //connected regions, numbered in the order they are found
+    for (size_t cell = 0; cell < cellCount; cell++) {
+        if (regions[cell] != 0 || (walls[cell / 8] >> (cell % 8) & 1)) continue;
+        header.regionCount++;
+        size_t head = 0, tail = 0;
+        regions[cell] = header.regionCount;
+        queue[tail++] = cell;
+        while (head < tail) {
+            uint32_t next = queue[head++];
+            int y = next / cols, x = next % cols;
+            for (int dir = up; dir <= right; dir++) {
+                int ny = y + directionY[dir], nx = x + directionX[dir];
+                if (ny < 0 || ny >= rows || nx < 0 || nx >= cols) continue;
+                uint32_t n = ny * cols + nx;
+                if (regions[n] != 0 || (walls[n / 8] >> (n % 8) & 1)) continue;
+                regions[n] = header.regionCount;
+                queue[tail++] = n;
+            }
+        }
+    }
+
+    //landmarks picked farthest first, an unreachable cell counts as farthest so every big region gets one
+    uint32_t landmark = LEVEL_NO_START;
+    for (size_t cell = 0; cell < cellCount && landmark == LEVEL_NO_START; cell++)
+        if (regions[cell] != 0) landmark = cell;
+    for (size_t i = 0; i < cellCount; i++) nearest[i] = LEVEL_UNREACHABLE;
+    while (landmark != LEVEL_NO_START && header.landmarkCount < LEVEL_LANDMARKS) {
+        uint32_t *dist = distances + header.landmarkCount++ * cellCount;
+        levelSearch(walls, rows, cols, landmark, dist, queue);
+        landmark = LEVEL_NO_START;
+        uint32_t farthest = 0;
+        for (size_t cell = 0; cell < cellCount; cell++) {
+            if (dist[cell] < nearest[cell]) nearest[cell] = dist[cell];
+            if (regions[cell] != 0 && nearest[cell] > farthest) {
+                farthest = nearest[cell];
+                landmark = cell;
+            }
+        }
+    }
+
+    header.wallOffset = sizeof(levelHeader);
+    header.regionOffset = header.wallOffset + wallBytes;
+    header.distanceOffset = header.regionOffset + cellCount * sizeof(uint32_t);
+    header.size = header.distanceOffset + header.landmarkCount * cellCount * sizeof(uint32_t);
+
+    FILE *out = fopen(levelFile, "wb");
+    bool written = out != NULL &&
+        fwrite(&header, sizeof(header), 1, out) == 1 &&
+        fwrite(walls, wallBytes, 1, out) == 1 &&
+        fwrite(regions, cellCount * sizeof(uint32_t), 1, out) == 1 &&
+        fwrite(distances, cellCount * sizeof(uint32_t), header.landmarkCount, out) == header.landmarkCount;
+    if (out != NULL && fclose(out) != 0) written = false;
+    if (!written) perror(levelFile);
+    else printf("%s: %dx%d cells, %u regions, %u landmarks\n", levelFile, rows, cols, header.regionCount, header.landmarkCount);
+
+    free(walls);
+    free(regions);
+    free(distances);
+    free(nearest);
+    free(queue);
+    return written ? 0 : 1;
+}
+
+// True if a section of bytes at offset lies inside a file of size bytes
+bool levelSectionFits(uint64_t offset, uint64_t bytes, uint64_t size) {
+    return offset <= size && bytes <= size - offset;
 }
 
+/**
+ * Function: levelHeaderFits()
+ * Purpose: checks that the sections and the start a level header describes lie inside the level,
+ *          so a damaged file is turned away before anything reads past the end of the map
+**/
+bool levelHeaderFits(const levelHeader *header) {
+    if (header->rows == 0 || header->cols == 0 || header->landmarkCount > LEVEL_LANDMARKS) return false;
+    if (header->startY != LEVEL_NO_START && (header->startY >= header->rows || header->startX >= header->cols))
+        return false;
+    uint64_t cellCount = (uint64_t)header->rows * header->cols; // at most 2^64 - 2^33 + 1, no overflow
+    if (header->regionOffset % sizeof(uint32_t) != 0 || header->distanceOffset % sizeof(uint32_t) != 0 ||
+        !levelSectionFits(header->wallOffset, (cellCount + 63) / 64 * 8, header->size))
+        return false;
+    //the walls fit, so cellCount is at most 8 bits per byte of the file and the products below stay small
+    return levelSectionFits(header->regionOffset, cellCount * sizeof(uint32_t), header->size) &&
+           levelSectionFits(header->distanceOffset, header->landmarkCount * cellCount * sizeof(uint32_t), header->size);
+}
+
+/**
+ * Function: loadLevel()
+ * Purpose: maps a compiled level, exits with a message if it is not one
+**/
+void loadLevel(const char *path) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        perror(path);
+        exit(1);
+    }
+    void *map = (size_t)info.st_size >= sizeof(levelHeader) ?
+        mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    const levelHeader *header = map;
+    if (map == MAP_FAILED || memcmp(header->magic, LEVEL_MAGIC, sizeof(header->magic)) != 0 ||
+        header->size != (uint64_t)info.st_size || !levelHeaderFits(header)) {
+        fprintf(stderr, "%s: not a compiled level, make one with --compile-level\n", path);
+        exit(1);
+    }
+    level = header;
+    levelWalls = (const uint8_t*)map + header->wallOffset;
+    levelRegions = (const uint32_t*)((const char*)map + header->regionOffset);
+    levelDistances = (const uint32_t*)((const char*)map + header->distanceOffset);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    levelLoadTime = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// Index of a screen position in the level, -1 outside of it
+long levelCell(int y, int x) {
+    if (y < 1 || y > (int)level->rows || x < 1 || x > (int)level->cols) return -1;
+    return (long)(y - 1) * level->cols + (x - 1);
+}
+
+/**
+ * Function: drawLevel()
+ * Purpose: puts the walls of the level into the pit, the pit beyond the level is wall too
+**/
+void drawLevel() {
+    if (level->rows > (uint32_t)yMax - 2 || level->cols > (uint32_t)xMax - 2) {
+        endwin();
+        fprintf(stderr, "level is %ux%u, the terminal only fits %dx%d\n", level->rows, level->cols, yMax - 2, xMax - 2);
+        exit(1);
+    }
+    for (int y = 1; y < yMax - 1; y++)
+        for (int x = 1; x < xMax - 1; x++) {
+            long cell = levelCell(y, x);
+            if (cell < 0 || (levelWalls[cell / 8] >> (cell % 8) & 1))
+                displayCharAt(y, x, headless ? '#' : ACS_CKBOARD);
+        }
+}
+
+/**
+ * Function: levelRegionAt()
+ * Purpose: gets the connected region of a position, 0 for walls, every position is in region 1 without a level
+**/
+int levelRegionAt(int y, int x) {
+    if (level == NULL) return 1;
+    long cell = levelCell(y, x);
+    return cell < 0 ? 0 : levelRegions[cell];
+}
+
+// Lower bound on the steps between two positions, the best of the landmark bounds and the straight line distance
+uint32_t levelDistanceBound(int y1, int x1, int y2, int x2) {
+    uint32_t bound = abs(y1 - y2) + abs(x1 - x2);
+    long a = level == NULL ? -1 : levelCell(y1, x1), b = level == NULL ? -1 : levelCell(y2, x2);
+    if (a < 0 || b < 0) return bound;
+    size_t cellCount = (size_t)level->rows * level->cols;
+    for (uint32_t i = 0; i < level->landmarkCount; i++) {
+        const uint32_t *dist = levelDistances + i * cellCount;
+        if (dist[a] == LEVEL_UNREACHABLE || dist[b] == LEVEL_UNREACHABLE) continue;
+        uint32_t diff = dist[a] > dist[b] ? dist[a] - dist[b] : dist[b] - dist[a];
+        if (diff > bound) bound = diff;
+    }
+    return bound;
+}
+
+/**
+ * Function: followGreedy()
+ * Purpose: sets the direction of the free cell closest to the trophy, keeping the current direction on ties
+**/
+void followGreedy() {
+    dObj head = snakeHead();
+    int best = -1;
+    uint32_t bestBound = 0;
+    for (int i = 0; i < 4; i++) {
+        int dir = (state->currentDirection + i) % 4;
+        int y = head.y + directionY[dir], x = head.x + directionX[dir];
+        if (!isFreeCell(y, x)) continue;
+        uint32_t bound = levelDistanceBound(y, x, state->prevTrophy.y, state->prevTrophy.x);
+        if (best < 0 || bound < bestBound) {
+            best = dir;
+            bestBound = bound;
+        }
+    }
+    if (best >= 0) setDirection(best);
+}
+// --------------------------------------------------------------------------
+// End of Levels
+
+/**
+ * Code Block: Lookahead
+ * Purpose: Monte Carlo autopilot. Every tick one worker thread per core copies the game with
+ *          cloneGameState() and plays short random futures (rollouts) from each possible first move
+ *          until the time budget of the tick is used up, then the snake takes the first move whose
+ *          rollouts survived longest and scored most. The copies run the real updateState(), each
+ *          worker thread's state pointing at its own copy.
+**/
+// --------------------------------------------------------------------------
+#define LOOKAHEAD_DEPTH 64 // ticks played per rollout
+#define LOOKAHEAD_SCORE_WEIGHT 8 // a point of score counts as this many ticks survived
+
+typedef struct lookaheadWorker {
+    pthread_t thread;
+    gameState *copy;
+    uint64_t rng; // for the rollout moves and to reseed the copies, so workers play different futures
+    double total[4]; // summed rollout values per first direction
+    long count[4];
+} lookaheadWorker;
+
+lookaheadWorker *lookaheadWorkers = NULL;
+int lookaheadThreads = 0;
+int lookaheadMoves[4], lookaheadMoveCount;
+double lookaheadDeadline, lookaheadTime = 0; //lookaheadTime is the total time spent on rollouts
+pthread_barrier_t lookaheadStart, lookaheadDone;
+bool lookaheadStop = false; //set before releasing the workers a last time, they quit instead of playing
+atomic_ulong lookaheadRollouts = 0;
+
+// splitmix64, the random numbers of the workers themselves
+uint64_t lookaheadRandom(uint64_t *rng) {
+    uint64_t z = (*rng += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Plays one future of the copy in state after the first move, returns how good it went
+double lookaheadRollout(enum Direction first, uint64_t *rng) {
+    int startScore = state->snakeSize, ticks = 0;
+    setDirection(first);
+    while (!state->gameOver && ticks < LOOKAHEAD_DEPTH) {
+        updateState();
+        ticks++;
+
+        //half of the moves head for the trophy, the other half are random, both only onto free cells
+        dObj head = snakeHead();
+        int free[4], freeCount = 0, closest = -1;
+        uint32_t closestBound = UINT32_MAX;
+        for (int dir = up; dir <= right; dir++) {
+            int y = head.y + directionY[dir], x = head.x + directionX[dir];
+            if (!isFreeCell(y, x)) continue;
+            free[freeCount++] = dir;
+            uint32_t bound = levelDistanceBound(y, x, state->prevTrophy.y, state->prevTrophy.x);
+            if (bound < closestBound) {
+                closest = dir;
+                closestBound = bound;
+            }
+        }
+        uint64_t r = lookaheadRandom(rng);
+        if (freeCount > 0) setDirection(r & 1 ? closest : free[(r >> 1) % freeCount]);
+    }
+    bool survived = !state->gameOver || state->winGame;
+    return (survived ? LOOKAHEAD_DEPTH : ticks) + LOOKAHEAD_SCORE_WEIGHT * (state->snakeSize - startScore);
+}
+
+// Body of a worker thread, plays rollouts between the two barriers of every tick
+void *lookaheadLoop(void *arg) {
+    lookaheadWorker *worker = arg;
+    TRACE_MUTE(); //rollouts would flood the trace
+    state = worker->copy;
+    for (;;) {
+        pthread_barrier_wait(&lookaheadStart);
+        if (lookaheadStop) break;
+        memset(worker->total, 0, sizeof(worker->total));
+        memset(worker->count, 0, sizeof(worker->count));
+        for (int i = worker - lookaheadWorkers; monotonicSeconds() < lookaheadDeadline; i++) {
+            int first = lookaheadMoves[i % lookaheadMoveCount];
+            cloneGameState(worker->copy, game);
+            worker->copy->rng = lookaheadRandom(&worker->rng) | 1; //the real next trophies are not known
+            worker->total[first] += lookaheadRollout(first, &worker->rng);
+            worker->count[first]++;
+        }
+        pthread_barrier_wait(&lookaheadDone);
+    }
+    return NULL;
+}
+
+/**
+ * Function: followLookahead()
+ * Purpose: sets the direction whose rollouts did best, starts the workers the first time
+**/
+void followLookahead() {
+    if (lookaheadWorkers == NULL) {
+        lookaheadThreads = sysconf(_SC_NPROCESSORS_ONLN);
+        if (lookaheadThreads < 1) lookaheadThreads = 1;
+        lookaheadWorkers = calloc(lookaheadThreads, sizeof(lookaheadWorker));
+        pthread_barrier_init(&lookaheadStart, NULL, lookaheadThreads + 1);
+        pthread_barrier_init(&lookaheadDone, NULL, lookaheadThreads + 1);
+        for (int i = 0; i < lookaheadThreads; i++) {
+            lookaheadWorkers[i].copy = malloc(game->size);
+            lookaheadWorkers[i].rng = game->rng + i;
+            pthread_create(&lookaheadWorkers[i].thread, NULL, lookaheadLoop, &lookaheadWorkers[i]);
+        }
+    }
+
+    //only moves onto free cells are worth a look, with one of them there is nothing to decide
+    dObj head = snakeHead();
+    lookaheadMoveCount = 0;
+    for (int dir = up; dir <= right; dir++)
+        if (isFreeCell(head.y + directionY[dir], head.x + directionX[dir]))
+            lookaheadMoves[lookaheadMoveCount++] = dir;
+    if (lookaheadMoveCount == 0) return;
+    if (lookaheadMoveCount == 1) {
+        setDirection(lookaheadMoves[0]);
+        return;
+    }
+
+    double start = monotonicSeconds();
+    lookaheadDeadline = start + (lookaheadBudget > 0 ? lookaheadBudget : tickDelay / 2) / 1000.0;
+    pthread_barrier_wait(&lookaheadStart);
+    pthread_barrier_wait(&lookaheadDone);
+    lookaheadTime += monotonicSeconds() - start;
+
+    double total[4] = {0};
+    long count[4] = {0};
+    for (int i = 0; i < lookaheadThreads; i++)
+        for (int dir = up; dir <= right; dir++) {
+            total[dir] += lookaheadWorkers[i].total[dir];
+            count[dir] += lookaheadWorkers[i].count[dir];
+            atomic_fetch_add(&lookaheadRollouts, lookaheadWorkers[i].count[dir]);
+        }
+    int best = lookaheadMoves[0];
+    for (int i = 1; i < lookaheadMoveCount; i++) {
+        int dir = lookaheadMoves[i];
+        if (count[dir] > 0 && (count[best] == 0 || total[dir] / count[dir] > total[best] / count[best]))
+            best = dir;
+    }
+    setDirection(best);
+}
+
+/**
+ * Function: stopLookahead()
+ * Purpose: lets the workers quit, waits for them and frees what followLookahead() set up
+**/
+void stopLookahead() {
+    if (lookaheadWorkers == NULL) return;
+    lookaheadStop = true;
+    pthread_barrier_wait(&lookaheadStart);
+    for (int i = 0; i < lookaheadThreads; i++) {
+        pthread_join(lookaheadWorkers[i].thread, NULL);
+        free(lookaheadWorkers[i].copy);
+    }
+    pthread_barrier_destroy(&lookaheadStart);
+    pthread_barrier_destroy(&lookaheadDone);
+    free(lookaheadWorkers);
+    lookaheadWorkers = NULL;
+    lookaheadStop = false;
+}
+// --------------------------------------------------------------------------
+// End of Lookahead
+
+/**
+ * Code Block: Benchmarks
+ * Purpose: micro benchmarks run from the command line instead of the game
+**/
+// --------------------------------------------------------------------------
+typedef struct coordRing { // the obvious alternative to the chain, a circular array of positions
+    uint64_t mask, first, count;
+    struct { int32_t y, x; } pieces[];
+} coordRing;
+
+/**
+ * Function: benchBody()
+ * Purpose: compares the snake chain against a ring of coordinates for a snake of the given length,
+ *          memory per piece, moving (push head and pop tail) and walking the whole body
+**/
+int benchBody(uint64_t segments) {
+    if (segments < 2) segments = 2;
+    uint64_t capacity = 32, moves = 20000000, walks = 5;
+    while (capacity < segments + 1) capacity *= 2;
+    srandom(1);
+    enum Direction *path = malloc(sizeof(enum Direction) * 4096); //random walk, turning back is fine here
+    for (int i = 0; i < 4096; i++) path[i] = random() % 4;
+    volatile long sink = 0;
+
+    snakeChain *chain = newSnakeChain(segments + 1);
+    coordRing *ring = calloc(1, sizeof(coordRing) + capacity * sizeof(ring->pieces[0]));
+    ring->mask = capacity - 1;
+
+    //build both snakes
+    int y = 0, x = 0;
+    chainPush(chain, y, x);
+    ring->pieces[ring->count++].y = 0;
+    for (uint64_t i = 0; i < segments; i++) {
+        y += directionY[path[i % 4096]];
+        x += directionX[path[i % 4096]];
+        chainPush(chain, y, x);
+        ring->pieces[ring->count & ring->mask].y = y;
+        ring->pieces[ring->count++ & ring->mask].x = x;
+    }
+
+    double start = monotonicSeconds();
+    for (uint64_t i = 0; i < moves; i++) {
+        chainPush(chain, chain->headY + directionY[path[i % 4096]], chain->headX + directionX[path[i % 4096]]);
+        chainPop(chain);
+    }
+    double chainMove = monotonicSeconds() - start;
+
+    start = monotonicSeconds();
+    for (uint64_t i = 0; i < moves; i++) {
+        uint64_t head = (ring->first + ring->count - 1) & ring->mask, next = (head + 1) & ring->mask;
+        ring->pieces[next].y = ring->pieces[head].y + directionY[path[i % 4096]];
+        ring->pieces[next].x = ring->pieces[head].x + directionX[path[i % 4096]];
+        ring->first = (ring->first + 1) & ring->mask;
+    }
+    double ringMove = monotonicSeconds() - start;
+
+    start = monotonicSeconds();
+    for (uint64_t w = 0; w < walks; w++) {
+        chainIter it = chainPieces(chain);
+        long sum = 0;
+        do sum += it.y ^ it.x; while (nextPiece(&it));
+        sink += sum;
+    }
+    double chainWalk = monotonicSeconds() - start;
+
+    start = monotonicSeconds();
+    for (uint64_t w = 0; w < walks; w++) {
+        long sum = 0;
+        for (uint64_t i = 0; i < ring->count; i++) {
+            uint64_t pos = (ring->first + i) & ring->mask;
+            sum += ring->pieces[pos].y ^ ring->pieces[pos].x;
+        }
+        sink += sum;
+    }
+    double ringWalk = monotonicSeconds() - start;
+
+    printf("snake of %llu pieces\n                             chain  coordinate ring\n", (unsigned long long)segments + 1);
+    printf("bytes per piece       %12.3f  %12.3f\n", (double)chain->capacity / 4 / (segments + 1),
+           (double)capacity * sizeof(ring->pieces[0]) / (segments + 1));
+    printf("move (ns)             %12.2f  %12.2f\n", chainMove * 1e9 / moves, ringMove * 1e9 / moves);
+    printf("walk (ns per piece)   %12.3f  %12.3f\n", chainWalk * 1e9 / walks / (segments + 1),
+           ringWalk * 1e9 / walks / (segments + 1));
+    free(path);
+    free(chain);
+    free(ring);
+    return 0;
+}
+
+typedef struct headlessRun {
+    double seconds;
+    uint64_t fingerprint; // the hashes of the last tick of every game folded together
+    unsigned long games, wins, trophies, rebuilds;
+    int longest; // longest snake of all games
+} headlessRun;
+
+/**
+ * Function: playHeadless()
+ * Purpose: plays games without a screen for the given number of ticks, steered by the hamiltonian or else
+ *          the greedy autopilot. A game that ends is followed by a new one with the next seed, so runs with
+ *          the same --seed play the same games.
+**/
+headlessRun playHeadless(uint64_t ticks) {
+    headlessRun run = {.games = 1};
+    uint64_t firstSeed = randomSeed = randomSeed != 0 ? randomSeed : 1;
+    initializeGame();
+    double start = monotonicSeconds();
+    for (uint64_t i = 0; i < ticks; i++) {
+        int size = state->snakeSize;
+        updateState();
+        run.trophies += state->snakeSize != size;
+        recordHash(run.games);
+        if (checkHash && state->hash != fullCellHash()) {
+            fprintf(stderr, "hash of game %lu differs from the cells at tick %llu\n", run.games,
+                    (unsigned long long)state->tick);
+            exit(1);
+        }
+        if (state->gameOver) {
+            run.fingerprint = (run.fingerprint << 1 | run.fingerprint >> 63) ^ gameHash();
+            run.wins += state->winGame;
+            run.rebuilds += state->regionRebuilds;
+            if (state->snakeSize > run.longest) run.longest = state->snakeSize;
+            free(game);
+            randomSeed++;
+            run.games++;
+            initializeGame();
+        }
+        else if (hamiltonianMode)
+            followHamiltonian();
+        else
+            followGreedy();
+    }
+    run.seconds = monotonicSeconds() - start;
+    run.fingerprint = (run.fingerprint << 1 | run.fingerprint >> 63) ^ gameHash();
+    run.rebuilds += state->regionRebuilds;
+    if (state->snakeSize > run.longest) run.longest = state->snakeSize;
+    free(game);
+    randomSeed = firstSeed;
+    return run;
+}
+
+// Gives a pit for the benchmarks when --size did not
+void benchSize(int rows, int cols) {
+    headless = true;
+    if (yMax < 5 || xMax < 5) {
+        yMax = rows;
+        xMax = cols;
+    }
+}
+
+/**
+ * Function: benchRegions()
+ * Purpose: plays the same games once without region tracking, once with the union-find and once with a
+ *          flood fill every tick, and compares the time per tick
+**/
+int benchRegions(uint64_t ticks) {
+    const char *names[] = {"level regions only", "union-find", "flood fill each tick"};
+    double perTick[3];
+    benchSize(202, 202);
+    printf("regions on a %dx%d pit, %llu ticks\n", yMax, xMax, (unsigned long long)ticks);
+    for (int mode = regionsOff; mode <= regionsFloodFill; mode++) {
+        regionTracking = mode;
+        headlessRun run = playHeadless(ticks);
+        perTick[mode] = run.seconds * 1e9 / ticks;
+        printf("%-22s %9.1f ns per tick, %+9.1f ns tracking, %lu games, %lu won, %lu trophies, %lu rebuilds\n",
+               names[mode], perTick[mode], perTick[mode] - perTick[regionsOff], run.games, run.wins, run.trophies,
+               run.rebuilds);
+    }
+    return 0;
+}
+
+/**
+ * Function: benchTicks()
+ * Purpose: plays the given number of ticks as fast as possible, for bots, batch runs and the PGO training
+ *          and comparison in the Makefile. The games are played once, make bench repeats the runs and
+ *          alternates the builds so the noise of a busy machine shows up as a spread instead of a winner.
+**/
+int benchTicks(uint64_t ticks) {
+    benchSize(level != NULL ? level->rows + 2 : 202, level != NULL ? level->cols + 2 : 202);
+    headlessRun run = playHeadless(ticks);
+    if (hashLog != NULL) fclose(hashLog);
+    hashLog = NULL;
+    printf("%s on a %dx%d pit: %.0f ticks per second, %llu ticks, %lu games, %lu won, %lu trophies, longest %d, "
+           "hash %016llx\n", hamiltonianMode ? "hamiltonian" : "greedy", yMax, xMax, ticks / run.seconds,
+           (unsigned long long)ticks, run.games, run.wins, run.trophies, run.longest, (unsigned long long)run.fingerprint);
+    return 0;
+}
+// --------------------------------------------------------------------------
+// End of Benchmarks
+
 /**
  * Function: displayMessage()
  * Purpose: blanks the row, then writes whatever message was passed
@@ -460,8 +2395,20 @@ void displayMessage(char* str) { //displays a generic message on board
  * Author: Corwin
 **/
 void exitGame() {
+    closeShare(); //first, a SIGKILL may follow before the pause is over
     displayMessage("Exiting");
     usleep(1300000);
     endwin();
+    TRACE_DUMP();
+    if (showStats)
+        fprintf(stderr, "ticks: %lu, late ticks: %lu, frames dropped by simulation: %lu, skipped by renderer: %lu\n",
+                (unsigned long)(game ? game->tick : 0), atomic_load(&simLateTicks), atomic_load(&simFramesDropped),
+                atomic_load(&renderFramesSkipped));
+    if (showStats && lookaheadMode)
+        fprintf(stderr, "lookahead: %lu rollouts on %d threads, %.0f rollouts/s\n", atomic_load(&lookaheadRollouts),
+                lookaheadThreads, lookaheadTime > 0 ? atomic_load(&lookaheadRollouts) / lookaheadTime : 0);
+    if (showStats && level != NULL)
+        fprintf(stderr, "level: %ux%u cells, %u regions, mapped in %.1f us\n",
+                level->rows, level->cols, level->regionCount, levelLoadTime * 1e6);
     exit(0);
 }
@@ -0,0 +1,376 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <pty.h>
+#include <sys/wait.h>
+
+/**
+ * Program: snakeLatency
+ * Purpose: measures the time from an arrow key to the screen showing the snake's head moved that way.
+ *          The game runs under forkpty() on a vt100 terminal of a chosen size. The harness follows the
+ *          output with a small terminal emulator; every '@' written on a cell that did not show one is a
+ *          new head. Once the heading is known it sends a turn at a random point of the tick and times
+ *          the first new head one step in the new direction from a head seen since the key.
+ *          A game that ends is started again until enough turns are measured, up to MAX_RESTARTS times.
+ *          A game that ends without ever drawing a head is not started again, the harness fails instead.
+ *
+ *          usage: snakeLatency [-n turns] [-s rowsxcols] [-t max-p99-ticks] game [game args]
+ *
+ *          Latency is reported in ms and in ticks (of the tick it was measured in), -t makes it exit
+ *          with 1 when the 99th percentile is more ticks than that, for make latency.
+**/
+
+enum Direction { up = 0, down = 1, left = 2, right = 3 };
+const int directionY[] = {-1, 1, 0, 0}, directionX[] = {0, 0, -1, 1};
+const char *arrowKeys[] = {"\033OA", "\033OB", "\033OD", "\033OC"}; // vt100 keypad mode, the game calls keypad()
+
+#define MAX_ROWS 200
+#define MAX_COLS 400
+#define MAX_HEADS 64 // heads remembered since a key was sent
+#define TURN_TIMEOUT 3.0 // seconds until a turn that never shows up counts as lost
+#define STEER_ROOM 3 // free cells ahead below which the next turn is sent early
+#define MAX_RESTARTS 20 // games started again before giving up
+#define EXIT_TIMEOUT 3.0 // seconds a game gets to exit after SIGINT, its exitGame() pauses 1.3 s
+
+int rows = 24, cols = 80, turnsWanted = 40;
+double maxTicks = 0; // -t, 0 for no check
+
+/**
+ * Code Block: Terminal
+ * Purpose: just enough of a vt100 to know which character is on which cell: printable characters with
+ *          auto wrap, cursor movement and erasing. Everything else ncurses sends is skipped.
+**/
+// --------------------------------------------------------------------------
+typedef struct headSeen {
+    int y, x;
+    double time;
+} headSeen;
+
+char screen[MAX_ROWS][MAX_COLS];
+int cursorY, cursorX;
+bool wrapPending;
+enum { text, escape, csi, charset } parserState = text;
+int params[16], paramCount;
+
+headSeen heads[MAX_HEADS]; // new heads in the order they were drawn, heads[0] the newest
+int headCount;
+
+void clearScreen(int fromY, int fromX, int toY, int toX) {
+    for (int y = fromY; y <= toY; y++)
+        for (int x = (y == fromY ? fromX : 0); x <= (y == toY ? toX : cols - 1); x++)
+            screen[y][x] = ' ';
+}
+
+void resetTerminal() {
+    clearScreen(0, 0, rows - 1, cols - 1);
+    cursorY = cursorX = 0;
+    wrapPending = false;
+    parserState = text;
+    headCount = 0;
+}
+
+int param(int i, int fallback) {
+    return i < paramCount && params[i] > 0 ? params[i] : fallback;
+}
+
+int clamp(int value, int low, int high) {
+    return value < low ? low : value > high ? high : value;
+}
+
+void putChar(char ch, double now) {
+    if (wrapPending) {
+        cursorX = 0;
+        if (cursorY < rows - 1) cursorY++;
+        wrapPending = false;
+    }
+    if (ch == '@' && screen[cursorY][cursorX] != '@') {
+        memmove(heads + 1, heads, sizeof(headSeen) * (MAX_HEADS - 1));
+        heads[0] = (headSeen){cursorY, cursorX, now};
+        if (headCount < MAX_HEADS) headCount++;
+    }
+    screen[cursorY][cursorX] = ch;
+    if (cursorX == cols - 1)
+        wrapPending = true;
+    else
+        cursorX++;
+}
+
+void runCsi(char command) {
+    switch (command) {
+        case 'H': case 'f':
+            cursorY = clamp(param(0, 1) - 1, 0, rows - 1);
+            cursorX = clamp(param(1, 1) - 1, 0, cols - 1);
+            break;
+        case 'A': cursorY = clamp(cursorY - param(0, 1), 0, rows - 1); break;
+        case 'B': cursorY = clamp(cursorY + param(0, 1), 0, rows - 1); break;
+        case 'C': cursorX = clamp(cursorX + param(0, 1), 0, cols - 1); break;
+        case 'D': cursorX = clamp(cursorX - param(0, 1), 0, cols - 1); break;
+        case 'G': cursorX = clamp(param(0, 1) - 1, 0, cols - 1); break;
+        case 'd': cursorY = clamp(param(0, 1) - 1, 0, rows - 1); break;
+        case 'K':
+            if (param(0, 0) == 0) clearScreen(cursorY, cursorX, cursorY, cols - 1);
+            else if (param(0, 0) == 1) clearScreen(cursorY, 0, cursorY, cursorX);
+            else clearScreen(cursorY, 0, cursorY, cols - 1);
+            break;
+        case 'J':
+            if (param(0, 0) == 0) clearScreen(cursorY, cursorX, rows - 1, cols - 1);
+            else if (param(0, 0) == 1) clearScreen(0, 0, cursorY, cursorX);
+            else clearScreen(0, 0, rows - 1, cols - 1);
+            break;
+        default: // modes, attributes, scroll regions
+            return;
+    }
+    wrapPending = false;
+}
+
+// Feeds output of the game through the emulator
+void feedTerminal(const char *data, ssize_t length, double now) {
+    for (ssize_t i = 0; i < length; i++) {
+        unsigned char ch = data[i];
+        switch (parserState) {
+            case escape:
+                if (ch == '[') {
+                    parserState = csi;
+                    paramCount = 0;
+                    memset(params, 0, sizeof(params));
+                }
+                else if (ch == '(' || ch == ')')
+                    parserState = charset;
+                else
+                    parserState = text;
+                break;
+            case charset:
+                parserState = text;
+                break;
+            case csi:
+                if (ch >= '0' && ch <= '9') {
+                    if (paramCount == 0) paramCount = 1;
+                    params[paramCount - 1] = params[paramCount - 1] * 10 + ch - '0';
+                }
+                else if (ch == ';') {
+                    if (paramCount == 0) paramCount = 1;
+                    if (paramCount < 16) paramCount++;
+                }
+                else if (ch >= 0x40 && ch <= 0x7e) {
+                    runCsi(ch);
+                    parserState = text;
+                }
+                break; // '?' and other intermediates
+            case text:
+                if (ch == 033) parserState = escape;
+                else if (ch == '\r') { cursorX = 0; wrapPending = false; }
+                else if (ch == '\n') { if (cursorY < rows - 1) cursorY++; wrapPending = false; }
+                else if (ch == '\b') { if (cursorX > 0) cursorX--; wrapPending = false; }
+                else if (ch >= 0x20 && ch < 0x7f) putChar(ch, now);
+                else if (ch >= 0xa0) putChar('#', now); // line drawing and other non ascii
+                break;
+        }
+    }
+}
+// --------------------------------------------------------------------------
+// End of Terminal
+
+/**
+ * Code Block: Measuring
+ * Purpose: runs the game, picks turns and collects the latencies
+**/
+// --------------------------------------------------------------------------
+double *latencies, *latencyTicks, *ticks; // ticks holds the length of the tick each turn was timed in
+int turnsMeasured, turnsLost, restarts;
+
+double monotonicSeconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Direction from one head to the next or -1 if they are not next to each other
+int directionBetween(headSeen from, headSeen to) {
+    for (int dir = up; dir <= right; dir++)
+        if (to.y == from.y + directionY[dir] && to.x == from.x + directionX[dir]) return dir;
+    return -1;
+}
+
+// Free cells in front of a head
+int roomAhead(headSeen head, int dir) {
+    int room = 0, y = head.y + directionY[dir], x = head.x + directionX[dir];
+    while (y >= 0 && y < rows && x >= 0 && x < cols && (screen[y][x] == ' ' || (screen[y][x] >= '1' && screen[y][x] <= '9'))) {
+        room++;
+        y += directionY[dir];
+        x += directionX[dir];
+    }
+    return room;
+}
+
+pid_t startGame(int *master, char **argv) {
+    struct winsize size = {.ws_row = rows, .ws_col = cols};
+    pid_t pid = forkpty(master, NULL, NULL, &size);
+    if (pid < 0) {
+        perror("forkpty");
+        exit(1);
+    }
+    if (pid == 0) {
+        setenv("TERM", "vt100", 1);
+        execvp(argv[0], argv);
+        perror(argv[0]);
+        _exit(127);
+    }
+    resetTerminal();
+    return pid;
+}
+
+int compareDoubles(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+double percentile(double *sorted, int count, double p) {
+    return sorted[(int)(p * (count - 1) + 0.5)];
+}
+
+// Interrupts the game and waits for it to exit on its own, so it can clean up after itself,
+// the pty is drained meanwhile. A game that takes longer than EXIT_TIMEOUT is killed.
+void stopGame(pid_t pid, int master) {
+    char buffer[4096];
+    kill(pid, SIGINT);
+    double deadline = monotonicSeconds() + EXIT_TIMEOUT;
+    while (waitpid(pid, NULL, WNOHANG) == 0) {
+        if (monotonicSeconds() > deadline) {
+            kill(pid, SIGKILL);
+            waitpid(pid, NULL, 0);
+            break;
+        }
+        struct pollfd pfd = {master, POLLIN, 0};
+        if (poll(&pfd, 1, 10) > 0 && read(master, buffer, sizeof(buffer)) <= 0) usleep(10000);
+    }
+    close(master);
+}
+
+/**
+ * Function: measure()
+ * Purpose: plays the game through the pty until turnsWanted turns are timed
+**/
+void measure(char **argv) {
+    int master;
+    pid_t pid = startGame(&master, argv);
+    double keyTime = 0, nextKey = 0, tick = 0;
+    int turn = -1; // direction of the turn in flight
+    char buffer[65536];
+
+    while (turnsMeasured < turnsWanted) {
+        double now = monotonicSeconds();
+        int wait = nextKey > now ? (int)((nextKey - now) * 1000) + 1 : 10;
+        struct pollfd pfd = {master, POLLIN, 0};
+        if (poll(&pfd, 1, wait) > 0) {
+            ssize_t length = read(master, buffer, sizeof(buffer));
+            if (length <= 0) { //the game ended, start it again
+                close(master);
+                int status;
+                waitpid(pid, &status, 0);
+                if (headCount == 0 || restarts == MAX_RESTARTS) {
+                    fprintf(stderr, "%s ended %s, exit status %d\n", argv[0],
+                            headCount == 0 ? "without drawing the snake" : "too often", WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+                    exit(1);
+                }
+                if (turn >= 0) turnsLost++;
+                turn = -1;
+                nextKey = 0;
+                restarts++;
+                pid = startGame(&master, argv);
+                continue;
+            }
+            int before = headCount;
+            feedTerminal(buffer, length, monotonicSeconds());
+            if (headCount == before) continue;
+        }
+        now = monotonicSeconds();
+
+        if (turn >= 0) { //did a head drawn since the key move the new way?
+            int turned = -1;
+            for (int i = 0; i + 1 < headCount && heads[i].time >= keyTime; i++)
+                if (directionBetween(heads[i + 1], heads[i]) == turn) turned = i;
+            if (turned >= 0) {
+                latencies[turnsMeasured] = (heads[turned].time - keyTime) * 1000;
+                latencyTicks[turnsMeasured] = (heads[turned].time - keyTime) / tick;
+                ticks[turnsMeasured] = tick * 1000;
+                turnsMeasured++;
+                turn = -1;
+                nextKey = 0;
+            }
+            else if (now - keyTime > TURN_TIMEOUT) {
+                turnsLost++;
+                turn = -1;
+                nextKey = 0;
+            }
+            continue;
+        }
+
+        //the heading and the tick come from the last two heads, after the three pieces a game starts with
+        if (headCount < 5) continue;
+        int heading = directionBetween(heads[1], heads[0]);
+        if (heading < 0) continue;
+        double interval = heads[0].time - heads[1].time;
+        if (nextKey == 0) { //a random point of the next tick, earlier when a wall is close
+            tick = interval;
+            nextKey = now + (double)rand() / RAND_MAX * tick * (roomAhead(heads[0], heading) < STEER_ROOM ? 0.5 : 2);
+            continue;
+        }
+        if (now < nextKey) continue;
+
+        //turn to the side with more room
+        int side = heading <= down ? left : up;
+        turn = roomAhead(heads[0], side) >= roomAhead(heads[0], side + 1) ? side : side + 1;
+        keyTime = monotonicSeconds();
+        if (write(master, arrowKeys[turn], strlen(arrowKeys[turn])) < 0) {
+            perror("write");
+            exit(1);
+        }
+    }
+    stopGame(pid, master);
+}
+// --------------------------------------------------------------------------
+// End of Measuring
+
+int main(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "+n:s:t:")) != -1) {
+        if (opt == 'n') turnsWanted = atoi(optarg);
+        else if (opt == 's' && sscanf(optarg, "%dx%d", &rows, &cols) == 2 && rows > 0 && rows <= MAX_ROWS &&
+                 cols > 0 && cols <= MAX_COLS) ;
+        else if (opt == 't') maxTicks = atof(optarg);
+        else optind = argc + 1;
+    }
+    if (optind >= argc || turnsWanted < 1) {
+        fprintf(stderr, "usage: %s [-n turns] [-s rowsxcols] [-t max-p99-ticks] game [game args]\n", argv[0]);
+        return 2;
+    }
+    srand(time(NULL) ^ getpid());
+    latencies = calloc(turnsWanted, sizeof(double));
+    latencyTicks = calloc(turnsWanted, sizeof(double));
+    ticks = calloc(turnsWanted, sizeof(double));
+    measure(argv + optind);
+
+    qsort(latencies, turnsMeasured, sizeof(double), compareDoubles);
+    qsort(latencyTicks, turnsMeasured, sizeof(double), compareDoubles);
+    qsort(ticks, turnsMeasured, sizeof(double), compareDoubles);
+    double p99 = percentile(latencyTicks, turnsMeasured, 0.99);
+    for (int i = optind; i < argc; i++) printf("%s ", argv[i]);
+    printf("on %dx%d: %d turns, %d lost, %d restarts, ticks of %.0f to %.0f ms\n", rows, cols,
+           turnsMeasured, turnsLost, restarts, ticks[0], ticks[turnsMeasured - 1]);
+    printf("  ms     min %6.1f  p50 %6.1f  p90 %6.1f  p99 %6.1f  max %6.1f\n", latencies[0],
+           percentile(latencies, turnsMeasured, 0.5), percentile(latencies, turnsMeasured, 0.9),
+           percentile(latencies, turnsMeasured, 0.99), latencies[turnsMeasured - 1]);
+    printf("  ticks  min %6.2f  p50 %6.2f  p90 %6.2f  p99 %6.2f  max %6.2f\n", latencyTicks[0],
+           percentile(latencyTicks, turnsMeasured, 0.5), percentile(latencyTicks, turnsMeasured, 0.9), p99,
+           latencyTicks[turnsMeasured - 1]);
+    if (maxTicks > 0 && p99 > maxTicks) {
+        printf("  p99 latency is %.2f ticks, more than %.2f\n", p99, maxTicks);
+        return 1;
+    }
+    return 0;
+}